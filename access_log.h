@@ -0,0 +1,130 @@
+#pragma once
+#include "includes.h"
+#include "spsc_ring.h"
+#include "thread_drainer.h"
+
+// Access log kept off the event loop: connections push one fixed-size record per request into a
+// ring owned by their thread, and a background writer formats whole batches into a single write.
+// A full ring drops the record and counts it instead of stalling the connection.
+namespace access_logging
+{
+	struct record
+	{
+		std::chrono::system_clock::time_point received;
+		std::string_view route;
+		boost::asio::ip::address peer;
+		boost::beast::http::verb method{};
+		unsigned status{};
+		uint64_t bytes_in{};
+		uint64_t bytes_out{};
+		std::chrono::microseconds handle_time{};
+		std::chrono::microseconds write_time{};
+	};
+
+	// Explicit router argument through which the router reports the endpoint that handled the
+	// request; `route` stays empty when none did.
+	struct matched_route
+	{
+		std::string_view route;
+	};
+
+	class logger
+	{
+		static constexpr size_t ring_capacity{ 1 << 13 };
+
+		struct thread_buffer
+		{
+			spsc_ring<record, ring_capacity> records;
+		};
+
+		thread_drainer<thread_buffer> m_drainer;
+		std::FILE* m_file{};
+		std::string m_batch;
+
+		logger() = default;
+
+		void flush()
+		{
+			m_batch.clear();
+			m_drainer.for_each_buffer([&](thread_buffer& buffer) {
+				buffer.records.consume_all([&](const record& r) {
+					auto method{ boost::beast::http::to_string(r.method) };
+					std::format_to(std::back_inserter(m_batch), "{:%FT%T}Z {} {} {} {} in={} out={} handle_us={} write_us={}\n",
+						std::chrono::floor<std::chrono::microseconds>(r.received), r.peer.to_string(),
+						std::string_view{ method.data(), method.size() }, r.route.empty() ? std::string_view{ "-" } : r.route, r.status,
+						r.bytes_in, r.bytes_out, r.handle_time.count(), r.write_time.count());
+				});
+			});
+
+			if (!m_batch.empty())
+			{
+				std::fwrite(m_batch.data(), 1, m_batch.size(), m_file);
+				std::fflush(m_file);
+			}
+		}
+
+	public:
+		static logger& instance()
+		{
+			static logger l;
+			return l;
+		}
+
+		logger(const logger&) = delete;
+		logger& operator =(const logger&) = delete;
+
+		~logger()
+		{
+			disable();
+		}
+
+		bool enabled() const noexcept
+		{
+			return m_drainer.enabled();
+		}
+
+		uint64_t dropped() const noexcept
+		{
+			return m_drainer.dropped();
+		}
+
+		// Starts appending to `path` ("-" for stdout), writing out what was logged every `flush_interval`.
+		void enable(const std::string& path, std::chrono::milliseconds flush_interval = 200ms)
+		{
+			disable();
+
+			m_file = path == "-" ? stdout : std::fopen(path.c_str(), "ab");
+			if (!m_file)
+				throw std::runtime_error{ std::format("cannot open access log {}", path) };
+
+			m_drainer.start(flush_interval, [this] { flush(); });
+		}
+
+		void disable()
+		{
+			m_drainer.stop();
+			if (m_file)
+			{
+				flush();
+				if (m_file != stdout)
+					std::fclose(m_file);
+				m_file = nullptr;
+			}
+		}
+
+		void log(const record& r)
+		{
+			if (!m_drainer.local().records.try_push(r))
+				m_drainer.count_drop();
+		}
+	};
+
+	// URL_ROUTER_ACCESS_LOG=<file> (or "-" for stdout) enables the access log.
+	inline void enable_from_environment()
+	{
+		auto path{ std::getenv("URL_ROUTER_ACCESS_LOG") };
+		if (!path || !*path)
+			return;
+		logger::instance().enable(path);
+	}
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include "includes.h"
+
+struct body_limit_policy {};
+
+// Endpoint policy: requests to the endpoint may carry at most `bytes_` of body. Larger ones are
+// answered 413 from their head, before any of the body is read.
+template<uint64_t bytes_>
+struct body_limit : body_limit_policy
+{
+	static constexpr uint64_t bytes{ bytes_ };
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include "includes.h"
+#include "defs.h"
+
+// Plain text response for `version` and `keep_alive`, as sent for requests no endpoint handles.
+inline response text_response(http::status status, std::string_view body, unsigned version, bool keep_alive,
+	std::initializer_list<std::pair<http::field, std::string_view>> headers = {})
+{
+	response r{ status, version, shared_text{ body } };
+	r.set(http::field::content_type, "text/plain");
+	for (auto& [field, value] : headers)
+		r.set(field, value);
+	r.keep_alive(keep_alive);
+	r.prepare_payload();
+	return r;
+}
+
+// The bytes of `r` as written to the socket.
+inline std::string serialize_response(const response& r)
+{
+	std::ostringstream out;
+	out << r;
+	return std::move(out).str();
+}
+
+// A fixed text response (400, 404, 413, 426, 429 and the like) built once for HTTP/1.0 and 1.1,
+// with and without keep-alive. The router hands out copies, which share the body; the server
+// writes the serialized bytes of the ones it sends before reading a request body.
+class canned_response
+{
+	std::array<std::array<response, 2>, 2> m_responses;
+	std::array<std::array<std::string, 2>, 2> m_wire;
+
+	static size_t version_index(unsigned version) noexcept
+	{
+		return version >= 11;
+	}
+
+public:
+	canned_response(http::status status, std::string_view body, std::initializer_list<std::pair<http::field, std::string_view>> headers = {})
+	{
+		for (unsigned version : { 10u, 11u })
+			for (bool keep_alive : { false, true })
+			{
+				auto& r{ m_responses[version_index(version)][keep_alive] };
+				r = text_response(status, body, version, keep_alive, headers);
+				m_wire[version_index(version)][keep_alive] = serialize_response(r);
+			}
+	}
+
+	response operator ()(unsigned version, bool keep_alive) const
+	{
+		return m_responses[version_index(version)][keep_alive];
+	}
+
+	response operator ()(const request& req) const
+	{
+		return (*this)(req.version(), req.keep_alive());
+	}
+
+	std::string_view wire(unsigned version, bool keep_alive) const
+	{
+		return m_wire[version_index(version)][keep_alive];
+	}
+};
@@ -0,0 +1,264 @@
+#pragma once
+#include "includes.h"
+#include "thread_drainer.h"
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+// Capture of request heads for replaying real traffic against the router. The file is the magic
+// "URCAP001" followed by back to back records in host byte order:
+//   u16 method, u16 header count, u32 target length, target,
+//   per header: u16 field, u32 value length, value.
+// Bodies are not captured.
+namespace traffic_capture
+{
+	constexpr std::string_view magic{ "URCAP001" };
+
+	template<typename T>
+	void append_raw(std::string& out, T value)
+	{
+		char bytes[sizeof(T)];
+		std::memcpy(bytes, &value, sizeof(T));
+		out.append(bytes, sizeof(T));
+	}
+
+	template<typename T>
+	bool read_raw(std::string_view& in, T& value)
+	{
+		if (in.size() < sizeof(T))
+			return false;
+		std::memcpy(&value, in.data(), sizeof(T));
+		in.remove_prefix(sizeof(T));
+		return true;
+	}
+
+	// Records heads from any number of connection threads: each appends to a buffer of its own,
+	// and the background writer swaps every buffer for an empty one and writes the full one out.
+	// The per-buffer mutex is only ever contended by that swap. When the writer falls more than
+	// `max_pending` bytes behind on a thread, its records are dropped and counted. Records keep
+	// their order within a thread; threads are interleaved one flush interval at a time.
+	class recorder
+	{
+		static constexpr size_t max_pending{ 4 << 20 };
+
+		struct thread_buffer
+		{
+			std::mutex mutex;
+			std::string records;
+		};
+
+		thread_drainer<thread_buffer> m_drainer;
+		std::vector<boost::beast::http::field> m_fields;
+		std::string m_spare;
+		std::FILE* m_file{};
+
+		recorder() = default;
+
+		void flush()
+		{
+			bool written{};
+			m_drainer.for_each_buffer([&](thread_buffer& buffer) {
+				{
+					std::scoped_lock lock{ buffer.mutex };
+					m_spare.swap(buffer.records);
+				}
+				if (!m_spare.empty())
+				{
+					std::fwrite(m_spare.data(), 1, m_spare.size(), m_file);
+					m_spare.clear();
+					written = true;
+				}
+			});
+			if (written)
+				std::fflush(m_file);
+		}
+
+	public:
+		static recorder& instance()
+		{
+			static recorder r;
+			return r;
+		}
+
+		recorder(const recorder&) = delete;
+		recorder& operator =(const recorder&) = delete;
+
+		~recorder()
+		{
+			disable();
+		}
+
+		bool enabled() const noexcept
+		{
+			return m_drainer.enabled();
+		}
+
+		uint64_t dropped() const noexcept
+		{
+			return m_drainer.dropped();
+		}
+
+		// Starts a new capture in `path` keeping the listed headers of every request.
+		void enable(const std::string& path, std::vector<boost::beast::http::field> fields, std::chrono::milliseconds flush_interval = 200ms)
+		{
+			disable();
+
+			m_file = std::fopen(path.c_str(), "wb");
+			if (!m_file)
+				throw std::runtime_error{ std::format("cannot open capture file {}", path) };
+			std::fwrite(magic.data(), 1, magic.size(), m_file);
+			m_fields = std::move(fields);
+
+			m_drainer.start(flush_interval, [this] { flush(); });
+		}
+
+		void disable()
+		{
+			m_drainer.stop();
+			if (m_file)
+			{
+				flush();
+				std::fclose(m_file);
+				m_file = nullptr;
+			}
+		}
+
+		void record(const request& req)
+		{
+			std::array<std::pair<boost::beast::http::field, std::string_view>, 16> headers;
+			size_t header_count{};
+			for (auto field : m_fields)
+				if (auto i{ req.find(field) }; i != req.end() && header_count < headers.size())
+					headers[header_count++] = { field, { i->value().data(), i->value().size() } };
+
+			std::string_view target{ req.target().data(), req.target().size() };
+			auto& buffer{ m_drainer.local() };
+			std::scoped_lock lock{ buffer.mutex };
+			auto& out{ buffer.records };
+			if (out.size() > max_pending)
+			{
+				m_drainer.count_drop();
+				return;
+			}
+			append_raw(out, static_cast<uint16_t>(req.method()));
+			append_raw(out, static_cast<uint16_t>(header_count));
+			append_raw(out, static_cast<uint32_t>(target.size()));
+			out += target;
+			for (size_t i{}; i < header_count; ++i)
+			{
+				append_raw(out, static_cast<uint16_t>(headers[i].first));
+				append_raw(out, static_cast<uint32_t>(headers[i].second.size()));
+				out += headers[i].second;
+			}
+		}
+	};
+
+	struct entry
+	{
+		boost::beast::http::verb method;
+		std::string_view target;
+		std::vector<std::pair<boost::beast::http::field, std::string_view>> headers;
+	};
+
+	// Walks the records of a capture held in memory; views point into `data`. Returns false for
+	// a file that is not a capture or ends in a truncated record.
+	template<typename F>
+	bool for_each_entry(std::string_view data, F&& f)
+	{
+		if (!data.starts_with(magic))
+			return false;
+		data.remove_prefix(magic.size());
+
+		entry e;
+		while (!data.empty())
+		{
+			uint16_t method, header_count;
+			uint32_t target_length;
+			if (!read_raw(data, method) || !read_raw(data, header_count) || !read_raw(data, target_length) || data.size() < target_length)
+				return false;
+			e.method = static_cast<boost::beast::http::verb>(method);
+			e.target = data.substr(0, target_length);
+			data.remove_prefix(target_length);
+
+			e.headers.clear();
+			for (uint16_t i{}; i < header_count; ++i)
+			{
+				uint16_t field;
+				uint32_t value_length;
+				if (!read_raw(data, field) || !read_raw(data, value_length) || data.size() < value_length)
+					return false;
+				e.headers.emplace_back(static_cast<boost::beast::http::field>(field), data.substr(0, value_length));
+				data.remove_prefix(value_length);
+			}
+			f(e);
+		}
+		return true;
+	}
+
+	// Read-only view of a capture file: memory mapped where the platform allows, read into memory
+	// otherwise.
+	class mapped_file
+	{
+		std::string_view m_data;
+#if !defined(_WIN32)
+		void* m_mapping{ MAP_FAILED };
+#endif
+		std::string m_copy;
+
+	public:
+		explicit mapped_file(const std::string& path)
+		{
+#if !defined(_WIN32)
+			auto fd{ ::open(path.c_str(), O_RDONLY) };
+			if (fd < 0)
+				throw std::runtime_error{ std::format("cannot open capture file {}", path) };
+			struct stat st{};
+			if (::fstat(fd, &st) == 0 && st.st_size > 0)
+				m_mapping = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (m_mapping == MAP_FAILED)
+				throw std::runtime_error{ std::format("cannot map capture file {}", path) };
+			m_data = { static_cast<const char*>(m_mapping), static_cast<size_t>(st.st_size) };
+#else
+			std::FILE* file{ std::fopen(path.c_str(), "rb") };
+			if (!file)
+				throw std::runtime_error{ std::format("cannot open capture file {}", path) };
+			char chunk[1 << 16];
+			for (size_t n; (n = std::fread(chunk, 1, sizeof(chunk), file)) > 0;)
+				m_copy.append(chunk, n);
+			std::fclose(file);
+			m_data = m_copy;
+#endif
+		}
+
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator =(const mapped_file&) = delete;
+
+		~mapped_file()
+		{
+#if !defined(_WIN32)
+			if (m_mapping != MAP_FAILED)
+				::munmap(m_mapping, m_data.size());
+#endif
+		}
+
+		std::string_view data() const
+		{
+			return m_data;
+		}
+	};
+
+	// URL_ROUTER_CAPTURE=<file> records request heads with their Host, Content-Type, Accept and
+	// User-Agent headers.
+	inline void enable_from_environment()
+	{
+		auto path{ std::getenv("URL_ROUTER_CAPTURE") };
+		if (!path || !*path)
+			return;
+		recorder::instance().enable(path, { boost::beast::http::field::host, boost::beast::http::field::content_type,
+			boost::beast::http::field::accept, boost::beast::http::field::user_agent });
+	}
+}
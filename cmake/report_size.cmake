@@ -0,0 +1,5 @@
+# Usage: cmake -DFILE=<binary> -P report_size.cmake
+file(SIZE "${FILE}" size)
+math(EXPR size_kib "${size} / 1024")
+get_filename_component(name "${FILE}" NAME)
+message(STATUS "${name}: ${size} bytes (${size_kib} KiB)")
@@ -0,0 +1,134 @@
+#pragma once
+#include "includes.h"
+
+struct coalesce_policy {};
+
+// Endpoint policy: concurrent GET requests with equal path and query arguments share a single
+// run of the handler.
+struct coalesce : coalesce_policy {};
+
+template<typename T>
+void append_coalescing_value(std::string& key, const T& value)
+{
+	if constexpr (std::is_integral_v<T>)
+	{
+		std::array<char, 24> digits;
+		auto [end, ec] { std::to_chars(digits.data(), digits.data() + digits.size(), value) };
+		key.append(digits.data(), end);
+		key += ';';
+	}
+	else
+	{
+		std::string_view str{ value };
+		std::format_to(std::back_inserter(key), "{}:", str.size());
+		key += str;
+	}
+}
+
+// Table of in-flight handler runs keyed by argument values. The first request for a key spawns
+// the handler run on its executor, detached; it and every later request for the key park their
+// completion handler on the flight and are resumed on their own executor with the result (or
+// exception). Each receiver copies the response header, while the body, a shared_text_body,
+// stays one allocation for all of them. A cancelled request, the one that started the flight
+// included, only stops waiting: the run goes on for the others.
+template<typename result_type>
+class single_flight
+{
+	using signature = void(std::exception_ptr, std::shared_ptr<const result_type>);
+	using waiter = boost::asio::any_completion_handler<signature>;
+
+	struct flight
+	{
+		std::list<waiter> waiters;
+		bool done{};
+		std::exception_ptr error;
+		std::shared_ptr<const result_type> result;
+	};
+
+	std::mutex m_mutex;
+	std::unordered_map<std::string, std::shared_ptr<flight>> m_flights;
+
+	static void complete(waiter w, std::exception_ptr error, std::shared_ptr<const result_type> result)
+	{
+		auto ex{ boost::asio::get_associated_executor(w) };
+		boost::asio::post(ex, [w = std::move(w), error = std::move(error), result = std::move(result)]() mutable {
+			std::move(w)(std::move(error), std::move(result));
+		});
+	}
+
+	void finish(const std::string& key, const std::shared_ptr<flight>& current, std::exception_ptr error, std::shared_ptr<const result_type> result)
+	{
+		std::list<waiter> waiters;
+		{
+			std::scoped_lock lock{ m_mutex };
+			m_flights.erase(key);
+			current->done = true;
+			current->error = error;
+			current->result = result;
+			waiters.swap(current->waiters);
+		}
+		for (auto& w : waiters)
+			complete(std::move(w), error, result);
+	}
+
+	template<typename handler_t>
+	void wait(const std::shared_ptr<flight>& current, handler_t handler)
+	{
+		auto slot{ boost::asio::get_associated_cancellation_slot(handler) };
+		std::unique_lock lock{ m_mutex };
+		if (current->done)
+		{
+			lock.unlock();
+			complete(std::move(handler), current->error, current->result);
+			return;
+		}
+
+		auto w{ current->waiters.emplace(current->waiters.end(), std::move(handler)) };
+		if (slot.is_connected())
+			slot.assign([this, current, w](boost::asio::cancellation_type) {
+				std::unique_lock lock{ m_mutex };
+				// A finished flight has taken its waiters and completes them itself.
+				if (current->done)
+					return;
+				auto cancelled{ std::move(*w) };
+				current->waiters.erase(w);
+				lock.unlock();
+				complete(std::move(cancelled), std::make_exception_ptr(boost::system::system_error{ boost::asio::error::operation_aborted }), nullptr);
+			});
+	}
+
+public:
+	// `make_awaitable` must own everything the handler run uses; the run may outlive the request
+	// that started it.
+	template<typename executor_type, typename make_awaitable_t>
+	boost::asio::awaitable<std::shared_ptr<const result_type>> run(std::string key, executor_type executor, make_awaitable_t make_awaitable)
+	{
+		std::shared_ptr<flight> current;
+		bool leader{};
+		{
+			std::scoped_lock lock{ m_mutex };
+			auto [i, inserted] { m_flights.try_emplace(key) };
+			if (inserted)
+				i->second = std::make_shared<flight>();
+			current = i->second;
+			leader = inserted;
+		}
+
+		if (leader)
+			boost::asio::co_spawn(executor, make_awaitable(), [this, key, current](std::exception_ptr error, result_type value) {
+				std::shared_ptr<const result_type> result;
+				if (!error)
+					result = std::make_shared<const result_type>(std::move(value));
+				finish(key, current, std::move(error), std::move(result));
+			});
+
+		co_return co_await boost::asio::async_initiate<decltype(use_awaitable), signature>(
+			[this, &current](auto handler) { wait(current, std::move(handler)); }, use_awaitable);
+	}
+};
+
+template<auto route>
+struct route_single_flight
+{
+	static inline single_flight<response> flights;
+};
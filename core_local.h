@@ -0,0 +1,111 @@
+#pragma once
+#include "includes.h"
+
+// Endpoint argument holding the calling event loop thread's own instance of T, so handlers can
+// keep counters, caches or backend pools without sharing them between cores. It pays off with a
+// server that runs several event loop threads, each with an io_context of its own (see
+// http_server::share_accepts); with a single thread there is a single instance. Instances are
+// made on a thread's first request, padded to their own cache lines and kept for the life of the
+// program, so aggregates still include threads that have since exited. cpu_bound handlers get
+// the instance of the loop that routed the request while that loop keeps serving others, so
+// they must treat it as shared.
+template<typename T>
+struct core_local
+{
+	struct alignas(64) instance
+	{
+		T value{};
+		boost::asio::io_context* loop{};
+	};
+
+private:
+	struct registry
+	{
+		std::mutex mutex;
+		std::deque<instance> instances;
+	};
+
+	static registry& get_registry()
+	{
+		static registry r;
+		return r;
+	}
+
+	static inline thread_local instance* t_instance{};
+
+public:
+	T* value{};
+
+	operator T& ()
+	{
+		return *value;
+	}
+
+	T* operator ->()
+	{
+		return value;
+	}
+
+	T& operator *()
+	{
+		return *value;
+	}
+
+	// Instance of the calling thread; `loop` is the io_context the thread runs, used by broadcast.
+	// The thread must be the only one running `loop`, or broadcast could not reach the instance
+	// on its own thread.
+	static T& local(boost::asio::io_context* loop = nullptr)
+	{
+		if (!t_instance || (loop && !t_instance->loop))
+		{
+			auto& r{ get_registry() };
+			std::scoped_lock lock{ r.mutex };
+			if (!t_instance)
+				t_instance = &r.instances.emplace_back();
+			t_instance->loop = loop;
+		}
+		return t_instance->value;
+	}
+
+	// Visits every instance from the calling thread while their owners keep running; meant for
+	// instances built from atomics (relaxed loads of per-core counters and the like).
+	template<typename F>
+	static void for_each(F&& f)
+	{
+		auto& r{ get_registry() };
+		std::scoped_lock lock{ r.mutex };
+		for (auto& i : r.instances)
+			f(i.value);
+	}
+
+	template<typename R, typename F>
+	static R aggregate(R init, F&& f)
+	{
+		for_each([&](T& value) { init = f(std::move(init), value); });
+		return init;
+	}
+
+	// Runs `f` on every instance from the thread that owns it: posted to its event loop, or run
+	// right away from the calling thread for instances of threads without one. `f` runs without
+	// the registry locked, so it may use core_local itself.
+	template<typename F>
+	static void broadcast(F f)
+	{
+		std::vector<std::pair<instance*, boost::asio::io_context*>> targets;
+		{
+			auto& r{ get_registry() };
+			std::scoped_lock lock{ r.mutex };
+			for (auto& i : r.instances)
+				targets.emplace_back(&i, i.loop);
+		}
+
+		for (auto [i, loop] : targets)
+			if (loop)
+				boost::asio::post(*loop, [i, f] {
+					BOOST_ASSERT_MSG(t_instance == i, "core_local loop run by more than one thread");
+					f(i->value);
+				});
+			else
+				f(i->value);
+	}
+};
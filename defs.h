@@ -1,4 +1,5 @@
 #pragma once
+#include "shared_body.h"
 
 namespace beast = boost::beast;
 namespace http = beast::http;
@@ -8,5 +9,5 @@ using asio::use_awaitable;
 using asio::detached;
 using tcp = asio::ip::tcp;
 using request = http::request<http::string_body>;
-using response = http::response<http::string_body>;
+using response = http::response<shared_text_body>;
 using namespace std::literals;
@@ -0,0 +1,92 @@
+#pragma once
+#include "includes.h"
+#include "defs.h"
+#include "url_router.h"
+#include "server.h"
+
+// Endpoints of the url_router demo server, shared with the tests that route requests to them.
+
+// Slow on purpose, so concurrent identical requests share one wait and one response; the greeting
+// therefore depends only on what the coalescing key covers.
+inline get_endpoint<"/hello", coalesce> 
+hello(timer_wheel *wheel, query_arg<"name", std::string> name) { 
+	co_await wheel->async_wait(500ms, use_awaitable);
+	co_return response{ http::status::ok, 11, std::format("ahoj, {}\n", name.value.empty() ? "svete"sv : std::string_view{ name.value }) };
+}
+
+inline get_endpoint<"/hello2"> 
+hello2(reroute_t reroute) { 
+	co_return co_await reroute("/hello");
+}
+
+inline get_endpoint<"/div/<a>/<b>", rate_limit<100, 20, rate_limit_key::client_ip>> 
+divide(path_arg<"b", uint32_t> b, path_arg<"a", uint32_t> a, query_arg<"x", uint32_t> x)
+{
+	if (!b)
+		co_return response{ http::status::bad_request, 11, "to nejde\n" };
+
+	auto d{ a / b };
+	auto r{ a - d * b };
+	co_return response{ http::status::ok, 11, std::format("x = {}\n {}, zbytek {}\n", x.value, d, r) };
+}
+
+inline get_endpoint<"/fib/<n>", cpu_bound>
+fib(path_arg<"n", uint32_t> n)
+{
+	if (n > 90)
+		co_return response{ http::status::bad_request, 11, "moc velke\n" };
+
+	uint64_t a{}, b{ 1 };
+	for (uint32_t i{}; i < n; ++i)
+		b = std::exchange(a, b) + b;
+	co_return response{ http::status::ok, 11, std::format("fib({}) = {}\n", n.value, a) };
+}
+
+// Counts in the calling loop's own counter, so loops never contend for it.
+inline get_endpoint<"/hits">
+hits(core_local<std::atomic<uint64_t>> counter)
+{
+	counter->fetch_add(1, std::memory_order_relaxed);
+	co_return response{ http::status::ok, 11, "hit\n" };
+}
+
+// Sums the counters of all loops, which takes the registry lock: kept off the /hits path.
+inline get_endpoint<"/hits/total">
+hits_total()
+{
+	auto total{ core_local<std::atomic<uint64_t>>::aggregate(uint64_t{}, [](uint64_t sum, std::atomic<uint64_t>& c) {
+		return sum + c.load(std::memory_order_relaxed);
+	}) };
+	co_return response{ http::status::ok, 11, std::format("{} hits\n", total) };
+}
+
+// Sends every message back `times` times.
+inline websocket_endpoint<"/echo/<times>">
+echo(path_arg<"times", uint32_t> times, ws_channel* channel)
+{
+	while (auto message{ co_await channel->receive() })
+		for (uint32_t i{}; i < times; ++i)
+			channel->send(*message);
+	co_return websocket_closed();
+}
+
+inline any_endpoint<"*"> 
+not_found() 
+{ 
+	co_return response{ http::status::not_found, 11, "nemame, nevedeme\n" }; 
+}
+
+inline get_endpoint<"/api/aa">
+api_aa(reroute_t reroute) {
+	co_return co_await reroute("/hello");
+}
+
+inline router_t<&api_aa, &not_found> subrouter;
+
+inline get_endpoint<"/api/*"> 
+api(asio::io_context *ctx, request *req, reroute_t reroute, tracing::request_trace *trace) {
+	co_return co_await subrouter.route(*req, ctx, reroute, trace);
+}
+
+using demo_router = router_t<&hello, &divide, &fib, &hits_total, &hits, &echo, &api, &not_found>;
+using demo_server = simple_http_server<&hello, &divide, &fib, &hits_total, &hits, &echo, &api, &not_found>;
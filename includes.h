@@ -2,16 +2,46 @@
 #include <array>
 #include <cstddef>
 #include <algorithm>
+#include <numeric>
 #include <vector>
+#include <deque>
+#include <list>
 #include <string>
 #include <string_view>
 #include <tuple>
 #include <charconv>
 #include <functional>
 #include <print>
+#include <format>
+#include <optional>
+#include <expected>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <bit>
+#include <limits>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <stop_token>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <exception>
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#endif
 #include <boost/url.hpp>
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 #include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/any_completion_handler.hpp>
+#include <boost/asio/experimental/awaitable_operators.hpp>
 #include <ctre.hpp>
 
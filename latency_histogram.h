@@ -0,0 +1,81 @@
+#pragma once
+
+// Log-linear (HDR style) histogram of nanosecond latencies. Values below 2^sub_bucket_bits
+// are recorded exactly, larger values with a relative error of at most 2^-(sub_bucket_bits - 1).
+class latency_histogram
+{
+	static constexpr unsigned sub_bucket_bits{ 10 };
+	static constexpr uint64_t sub_bucket_count{ 1ull << sub_bucket_bits };
+	static constexpr uint64_t sub_bucket_half{ sub_bucket_count / 2 };
+	static constexpr unsigned max_value_bits{ 37 };
+	static constexpr uint64_t max_value{ (1ull << max_value_bits) - 1 };
+	static constexpr size_t index_count{ sub_bucket_count + (max_value_bits - sub_bucket_bits) * sub_bucket_half };
+
+	std::vector<uint64_t> m_counts = std::vector<uint64_t>(index_count);
+	uint64_t m_total{};
+	uint64_t m_min{ ~0ull };
+	uint64_t m_max{};
+	long double m_sum{};
+
+	static constexpr size_t index_of(uint64_t value)
+	{
+		if (value < sub_bucket_count)
+			return value;
+		unsigned shift{ static_cast<unsigned>(std::bit_width(value)) - sub_bucket_bits };
+		return sub_bucket_count + (shift - 1) * sub_bucket_half + ((value >> shift) - sub_bucket_half);
+	}
+
+	static constexpr uint64_t highest_value_at(size_t index)
+	{
+		if (index < sub_bucket_count)
+			return index;
+		unsigned shift{ static_cast<unsigned>((index - sub_bucket_count) / sub_bucket_half) + 1 };
+		uint64_t top{ (index - sub_bucket_count) % sub_bucket_half + sub_bucket_half };
+		return (top << shift) + (1ull << shift) - 1;
+	}
+
+public:
+	void record(uint64_t value)
+	{
+		value = std::min(value, max_value);
+		++m_counts[index_of(value)];
+		++m_total;
+		m_min = std::min(m_min, value);
+		m_max = std::max(m_max, value);
+		m_sum += value;
+	}
+
+	void record(std::chrono::nanoseconds value)
+	{
+		record(static_cast<uint64_t>(std::max(value.count(), std::chrono::nanoseconds::rep{})));
+	}
+
+	void merge(const latency_histogram& other)
+	{
+		for (size_t i{}; i < index_count; ++i)
+			m_counts[i] += other.m_counts[i];
+		m_total += other.m_total;
+		m_min = std::min(m_min, other.m_min);
+		m_max = std::max(m_max, other.m_max);
+		m_sum += other.m_sum;
+	}
+
+	uint64_t count() const { return m_total; }
+	uint64_t min() const { return m_total ? m_min : 0; }
+	uint64_t max() const { return m_max; }
+	double mean() const { return m_total ? static_cast<double>(m_sum / m_total) : 0.0; }
+
+	// Smallest recorded value such that `percentile` percent of all samples are less or equal.
+	uint64_t value_at_percentile(double percentile) const
+	{
+		if (!m_total)
+			return 0;
+		auto wanted{ static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * m_total)) };
+		wanted = std::max<uint64_t>(wanted, 1);
+		uint64_t seen{};
+		for (size_t i{}; i < index_count; ++i)
+			if ((seen += m_counts[i]) >= wanted)
+				return std::min(highest_value_at(i), m_max);
+		return m_max;
+	}
+};
@@ -0,0 +1,154 @@
+#pragma once
+#include "includes.h"
+#include "defs.h"
+#include "latency_histogram.h"
+
+struct load_target
+{
+	std::string target;
+	unsigned weight{ 1 };
+	std::string wire;
+};
+
+// Request mix shared by all client connections. Requests are serialized once up front so the
+// client side spends its time on the socket and not on formatting.
+struct load_plan
+{
+	std::vector<load_target> targets;
+	std::vector<size_t> schedule;
+	unsigned pipeline_depth{ 1 };
+
+	void add_target(std::string target, unsigned weight, http::verb method = http::verb::get, std::string_view body = {},
+		const std::vector<std::pair<http::field, std::string_view>>& headers = {})
+	{
+		request req{ method, target, 11 };
+		req.set(http::field::host, "127.0.0.1");
+		for (auto& [field, value] : headers)
+			req.set(field, value);
+		if (!body.empty())
+			req.body() = body;
+		req.prepare_payload();
+
+		std::ostringstream wire;
+		wire << req;
+		targets.push_back({ std::move(target), std::max(weight, 1u), std::move(wire).str() });
+	}
+
+	void build_schedule(uint32_t seed = 1)
+	{
+		schedule.clear();
+		for (size_t i{}; i < targets.size(); ++i)
+			schedule.insert(schedule.end(), targets[i].weight, i);
+		std::shuffle(schedule.begin(), schedule.end(), std::mt19937{ seed });
+	}
+};
+
+struct load_stats
+{
+	std::vector<latency_histogram> latencies;
+	std::vector<uint64_t> non_2xx;
+	uint64_t errors{};
+
+	explicit load_stats(size_t target_count)
+		: latencies(target_count), non_2xx(target_count)
+	{}
+
+	uint64_t completed() const
+	{
+		uint64_t total{};
+		for (auto& h : latencies)
+			total += h.count();
+		return total;
+	}
+
+	// For smoke tests: a run in which connections fell through after a few requests each is a
+	// failure, not a low score.
+	bool completed_at_least(uint64_t minimum) const
+	{
+		if (completed() >= minimum)
+			return true;
+		std::println(stderr, "only {} requests completed, expected at least {}", completed(), minimum);
+		return false;
+	}
+
+	void merge(const load_stats& other)
+	{
+		for (size_t i{}; i < latencies.size(); ++i)
+		{
+			latencies[i].merge(other.latencies[i]);
+			non_2xx[i] += other.non_2xx[i];
+		}
+		errors += other.errors;
+	}
+};
+
+// Drives one keep-alive connection until `until`, sending `pipeline_depth` requests back to back
+// and then reading their responses in order. Latency of each request is measured from the moment
+// its batch was written to the moment its response was fully parsed.
+template<typename socket_type>
+asio::awaitable<void> run_load_connection(socket_type socket, const load_plan& plan, load_stats& stats, size_t offset, std::chrono::steady_clock::time_point until)
+{
+	beast::flat_buffer buffer;
+	std::string batch;
+	std::vector<size_t> in_flight;
+	size_t cursor{ offset };
+
+	try {
+		while (std::chrono::steady_clock::now() < until)
+		{
+			batch.clear();
+			in_flight.clear();
+			for (unsigned i{}; i < plan.pipeline_depth; ++i)
+			{
+				auto index{ plan.schedule[cursor++ % plan.schedule.size()] };
+				in_flight.push_back(index);
+				batch += plan.targets[index].wire;
+			}
+
+			auto sent{ std::chrono::steady_clock::now() };
+			co_await asio::async_write(socket, asio::buffer(batch), use_awaitable);
+
+			for (auto index : in_flight)
+			{
+				response resp;
+				co_await http::async_read(socket, buffer, resp, use_awaitable);
+				stats.latencies[index].record(std::chrono::steady_clock::now() - sent);
+				if (resp.result_int() / 100 != 2)
+					++stats.non_2xx[index];
+				if (resp.need_eof())
+					co_return;
+			}
+		}
+		socket.shutdown(asio::socket_base::shutdown_both);
+	}
+	catch (std::exception&)
+	{
+		++stats.errors;
+	}
+}
+
+inline void print_load_report(const load_plan& plan, const load_stats& stats, std::chrono::duration<double> elapsed)
+{
+	auto us{ [](uint64_t ns) { return ns / 1000.0; } };
+
+	std::println("{:<32} {:>10} {:>12} {:>10} {:>10} {:>10} {:>10} {:>8}",
+		"target", "requests", "req/s", "p50 us", "p99 us", "p99.9 us", "max us", "non-2xx");
+	latency_histogram total;
+	uint64_t total_non_2xx{};
+	for (size_t i{}; i < plan.targets.size(); ++i)
+	{
+		auto& h{ stats.latencies[i] };
+		std::println("{:<32} {:>10} {:>12.0f} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>8}",
+			plan.targets[i].target, h.count(), h.count() / elapsed.count(),
+			us(h.value_at_percentile(50)), us(h.value_at_percentile(99)), us(h.value_at_percentile(99.9)), us(h.max()),
+			stats.non_2xx[i]);
+		total.merge(h);
+		total_non_2xx += stats.non_2xx[i];
+	}
+	std::println("{:<32} {:>10} {:>12.0f} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>8}",
+		"total", total.count(), total.count() / elapsed.count(),
+		us(total.value_at_percentile(50)), us(total.value_at_percentile(99)), us(total.value_at_percentile(99.9)), us(total.max()),
+		total_non_2xx);
+	if (stats.errors)
+		std::println("connection errors: {}", stats.errors);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "includes.h"
+#include "defs.h"
+#include "url_router.h"
+#include "server.h"
+
+// Endpoint set served by the load generator and the capture replay tool.
+
+inline get_endpoint<"/plaintext">
+plaintext()
+{
+	co_return response{ http::status::ok, 11, "Hello, World!" };
+}
+
+inline get_endpoint<"/item/<id>">
+item(path_arg<"id", uint32_t> id)
+{
+	co_return response{ http::status::ok, 11, std::format("item {}\n", id.value) };
+}
+
+inline get_endpoint<"/search">
+search(query_arg<"q", std::string> q, query_arg<"limit", uint32_t> limit)
+{
+	co_return response{ http::status::ok, 11, std::format("{} x{}\n", q.value, limit.value) };
+}
+
+inline post_endpoint<"/echo", body_limit<64 * 1024>>
+echo(request* req)
+{
+	co_return response{ http::status::ok, 11, req->body() };
+}
+
+inline any_endpoint<"*">
+fallback()
+{
+	co_return response{ http::status::not_found, 11, "not found\n" };
+}
+
+using load_router = router_t<&plaintext, &item, &search, &echo, &fallback>;
+using load_server = simple_http_server<&plaintext, &item, &search, &echo, &fallback>;
+
+// The "wide" route table puts this many routes that no load target asks for ahead of the ones
+// above, so every request is routed past them.
+constexpr size_t wide_filler_routes{ 64 };
+
+template<size_t i>
+consteval auto filler_route()
+{
+	literal route{ "/f00/<id>" };
+	route.str[2] = static_cast<char>('0' + i / 10);
+	route.str[3] = static_cast<char>('0' + i % 10);
+	return route;
+}
+
+template<size_t i>
+get_endpoint<filler_route<i>()>
+filler(path_arg<"id", uint32_t> id)
+{
+	co_return response{ http::status::ok, 11, std::format("filler {} {}\n", i, id.value) };
+}
+
+template<typename sequence>
+struct wide_load_routes;
+
+template<size_t...i>
+struct wide_load_routes<std::index_sequence<i...>>
+{
+	using server = simple_http_server<&filler<i>..., &plaintext, &item, &search, &echo, &fallback>;
+};
+
+using wide_load_server = wide_load_routes<std::make_index_sequence<wide_filler_routes>>::server;
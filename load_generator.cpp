@@ -0,0 +1,215 @@
+#include "includes.h"
+#include "defs.h"
+#include "url_router.h"
+#include "server.h"
+#include "load_client.h"
+#include "load_endpoints.h"
+
+struct options
+{
+	uint16_t port{ 34540 };
+	unsigned connections{ 16 };
+	unsigned client_threads{ 1 };
+	unsigned server_threads{ 1 };
+	unsigned pipeline_depth{ 1 };
+	std::chrono::seconds duration{ 10 };
+	std::chrono::seconds warmup{ 1 };
+	bool wide_routes{};
+	uint64_t min_requests{};
+	std::vector<std::pair<std::string, unsigned>> targets;
+};
+
+static void usage()
+{
+	std::println("usage: url_router_load [--port N] [--connections N] [--pipeline N] [--duration S] [--warmup S]");
+	std::println("                       [--client-threads N] [--server-threads N] [--routes basic|wide]");
+	std::println("                       [--target PATH[@WEIGHT]]... [--min-requests N]");
+	std::println("targets default to /plaintext, /item/42, /search?q=abc&limit=10 and /missing");
+	std::println("--routes wide serves them behind {} more routes", wide_filler_routes);
+	std::println("--min-requests fails the run (exit code 3) when fewer requests completed");
+}
+
+static std::optional<options> parse_options(int argc, char** argv)
+{
+	options opts;
+	for (int i{ 1 }; i < argc; ++i)
+	{
+		std::string_view arg{ argv[i] };
+		if (arg == "--help" || i + 1 == argc)
+			return std::nullopt;
+
+		std::string_view value{ argv[++i] };
+		auto number{ [&] {
+			unsigned n{};
+			if (auto [_, ec] { std::from_chars(value.data(), value.data() + value.size(), n) }; ec != std::errc{})
+				throw std::runtime_error{ std::format("bad value for {}: {}", arg, value) };
+			return n;
+		} };
+
+		if (arg == "--port")
+			opts.port = static_cast<uint16_t>(number());
+		else if (arg == "--connections")
+			opts.connections = std::max(number(), 1u);
+		else if (arg == "--pipeline")
+			opts.pipeline_depth = std::max(number(), 1u);
+		else if (arg == "--duration")
+			opts.duration = std::chrono::seconds{ number() };
+		else if (arg == "--warmup")
+			opts.warmup = std::chrono::seconds{ number() };
+		else if (arg == "--client-threads")
+			opts.client_threads = std::max(number(), 1u);
+		else if (arg == "--server-threads")
+			opts.server_threads = std::max(number(), 1u);
+		else if (arg == "--min-requests")
+			opts.min_requests = number();
+		else if (arg == "--routes")
+		{
+			if (value != "basic" && value != "wide")
+				throw std::runtime_error{ std::format("bad value for {}: {}", arg, value) };
+			opts.wide_routes = value == "wide";
+		}
+		else if (arg == "--target")
+		{
+			unsigned weight{ 1 };
+			if (auto at{ value.rfind('@') }; at != std::string_view::npos)
+			{
+				std::from_chars(value.data() + at + 1, value.data() + value.size(), weight);
+				value = value.substr(0, at);
+			}
+			opts.targets.emplace_back(value, weight);
+		}
+		else
+			return std::nullopt;
+	}
+
+	if (opts.targets.empty())
+		opts.targets = { { "/plaintext", 4 }, { "/item/42", 2 }, { "/search?q=abc&limit=10", 1 }, { "/missing", 1 } };
+	return opts;
+}
+
+// Runs `connections` client connections spread over `client_threads` io_contexts for `duration`
+// and returns the merged per-target statistics.
+static load_stats run_clients(const options& opts, const load_plan& plan, std::chrono::steady_clock::duration duration)
+{
+	auto until{ std::chrono::steady_clock::now() + duration };
+	tcp::endpoint server_endpoint{ asio::ip::address_v4::loopback(), opts.port };
+
+	std::vector<std::unique_ptr<asio::io_context>> contexts;
+	std::vector<load_stats> stats;
+	for (unsigned i{}; i < opts.client_threads; ++i)
+	{
+		contexts.push_back(std::make_unique<asio::io_context>(1));
+		stats.emplace_back(plan.targets.size());
+	}
+
+	for (unsigned i{}; i < opts.connections; ++i)
+	{
+		auto t{ i % opts.client_threads };
+		tcp::socket socket{ *contexts[t] };
+		socket.connect(server_endpoint);
+		socket.set_option(tcp::no_delay{ true });
+		co_spawn(*contexts[t], run_load_connection(std::move(socket), plan, stats[t], i * 7919, until), detached);
+	}
+
+	{
+		std::vector<std::jthread> threads;
+		for (auto& ctx : contexts)
+			threads.emplace_back([&ctx] { ctx->run(); });
+	}
+
+	load_stats total{ plan.targets.size() };
+	for (auto& s : stats)
+		total.merge(s);
+	return total;
+}
+
+// Serves the plan's targets from `server_type` on `server_threads` event loop threads and runs the
+// warmup and the measured clients against it. Every thread has its own io_context, and with it
+// its own timer wheel; the listening server hands accepted connections to the others in turn.
+template<typename server_type>
+static int run_benchmark(const options& opts, const load_plan& plan)
+{
+	using peer_type = typename server_type::base;
+
+	std::vector<std::unique_ptr<asio::io_context>> contexts;
+	for (unsigned i{}; i < opts.server_threads; ++i)
+		contexts.push_back(std::make_unique<asio::io_context>(1));
+
+	server_type server{ *contexts[0], opts.port, asio::ip::address_v4::loopback() };
+	std::vector<std::unique_ptr<peer_type>> peers;
+	std::vector<asio::executor_work_guard<asio::io_context::executor_type>> idle_guards;
+	for (unsigned i{ 1 }; i < opts.server_threads; ++i)
+	{
+		peers.push_back(std::make_unique<peer_type>(*contexts[i], opts.port, asio::ip::address_v4::loopback()));
+		server.share_accepts(*peers.back());
+		idle_guards.push_back(asio::make_work_guard(*contexts[i]));
+	}
+
+	std::vector<std::jthread> server_threads;
+	for (auto& ctx : contexts)
+		server_threads.emplace_back([&ctx] { ctx->run(); });
+
+	int result{};
+	try {
+		if (opts.warmup.count())
+			run_clients(opts, plan, opts.warmup);
+
+		auto start{ std::chrono::steady_clock::now() };
+		auto stats{ run_clients(opts, plan, opts.duration) };
+		std::chrono::duration<double> elapsed{ std::chrono::steady_clock::now() - start };
+
+		print_load_report(plan, stats, elapsed);
+		result = stats.errors ? 2 : 0;
+		if (!stats.completed_at_least(opts.min_requests))
+			result = 3;
+	}
+	catch (std::exception& ex)
+	{
+		std::println(stderr, "load generator failed: {}", ex.what());
+		result = 1;
+	}
+
+	for (auto& ctx : contexts)
+		ctx->stop();
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	std::optional<options> opts;
+	try {
+		opts = parse_options(argc, argv);
+	}
+	catch (std::exception& ex)
+	{
+		std::println(stderr, "{}", ex.what());
+	}
+	if (!opts)
+	{
+		usage();
+		return 1;
+	}
+
+	tracing::enable_from_environment();
+	access_logging::enable_from_environment();
+	traffic_capture::enable_from_environment();
+
+	load_plan plan;
+	plan.pipeline_depth = opts->pipeline_depth;
+	for (auto& [target, weight] : opts->targets)
+		plan.add_target(target, weight);
+	plan.build_schedule();
+
+	std::println("{} connections, pipeline depth {}, {} client threads, {} server threads, {} route table, {}s (+{}s warmup)",
+		opts->connections, opts->pipeline_depth, opts->client_threads, opts->server_threads, opts->wide_routes ? "wide" : "basic",
+		opts->duration.count(), opts->warmup.count());
+
+	auto result{ opts->wide_routes ? run_benchmark<wide_load_server>(*opts, plan) : run_benchmark<load_server>(*opts, plan) };
+
+	tracing::tracer::instance().disable();
+	access_logging::logger::instance().disable();
+	traffic_capture::recorder::instance().disable();
+	if (auto dropped{ access_logging::logger::instance().dropped() })
+		std::println("access log records dropped: {}", dropped);
+	return result;
+}
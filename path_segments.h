@@ -0,0 +1,103 @@
+#pragma once
+#include "includes.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define URL_ROUTER_HAS_SSE2 1
+#endif
+
+// Request path split at '/' in a single pass (16 bytes at a time where SSE2 is available), so
+// routes can compare and pick whole segments instead of rescanning characters. "/a/b" has the
+// segments "a" and "b", "/a/" has "a" and "", "/" has a single empty one.
+class path_segments
+{
+public:
+	static constexpr size_t capacity{ 32 };
+
+	// Length and first/last character in one word: a single compare rejects most fixed segments
+	// before their text is looked at.
+	static constexpr uint32_t fingerprint(std::string_view segment)
+	{
+		if (segment.empty())
+			return 0;
+		return static_cast<uint32_t>(segment.size()) << 16 | static_cast<uint32_t>(static_cast<unsigned char>(segment.front())) << 8
+			| static_cast<unsigned char>(segment.back());
+	}
+
+private:
+	struct segment
+	{
+		uint16_t offset;
+		uint16_t length;
+	};
+
+	std::string_view m_path;
+	std::array<segment, capacity> m_segments;
+	std::array<uint32_t, capacity> m_fingerprints;
+	size_t m_count{};
+	bool m_segmented{};
+
+	bool add(size_t& start, size_t end)
+	{
+		if (m_count == capacity)
+			return false;
+		m_segments[m_count] = { static_cast<uint16_t>(start), static_cast<uint16_t>(end - start) };
+		m_fingerprints[m_count] = fingerprint(m_path.substr(start, end - start));
+		++m_count;
+		start = end + 1;
+		return true;
+	}
+
+	bool scan()
+	{
+		auto data{ m_path.data() };
+		auto size{ m_path.size() };
+		size_t start{ 1 };
+		size_t i{ 1 };
+#if defined(URL_ROUTER_HAS_SSE2)
+		const auto slash{ _mm_set1_epi8('/') };
+		for (; i + 16 <= size; i += 16)
+		{
+			auto chunk{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)) };
+			for (auto mask{ static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, slash))) }; mask; mask &= mask - 1)
+				if (!add(start, i + std::countr_zero(mask)))
+					return false;
+		}
+#endif
+		for (; i < size; ++i)
+			if (data[i] == '/' && !add(start, i))
+				return false;
+		return add(start, size);
+	}
+
+public:
+	// Paths that are not absolute, longer than 64 KiB or with more than `capacity` segments are
+	// left unsegmented; routers fall back to character matching for them.
+	explicit path_segments(std::string_view path) : m_path{ path }
+	{
+		if (!path.empty() && path.front() == '/' && path.size() <= std::numeric_limits<uint16_t>::max())
+			m_segmented = scan();
+		if (!m_segmented)
+			m_count = 0;
+	}
+
+	bool segmented() const
+	{
+		return m_segmented;
+	}
+
+	size_t size() const
+	{
+		return m_count;
+	}
+
+	std::string_view operator [](size_t i) const
+	{
+		return m_path.substr(m_segments[i].offset, m_segments[i].length);
+	}
+
+	uint32_t fingerprint(size_t i) const
+	{
+		return m_fingerprints[i];
+	}
+};
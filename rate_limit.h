@@ -0,0 +1,146 @@
+#pragma once
+#include "includes.h"
+#include "canned_response.h"
+
+enum class rate_limit_key { global, client_ip, header };
+
+struct rate_limit_policy {};
+
+// Endpoint policy: at most `per_second` requests per second with bursts of up to `burst`,
+// counted for the whole endpoint, per client address or per value of `header`. Peers on Unix
+// domain sockets have no address: with rate_limit_key::client_ip all of them, typically a local
+// proxy forwarding every client, share a single bucket. Behind such a proxy, key on a header it
+// sets (X-Forwarded-For and the like) instead.
+template<uint32_t per_second, uint32_t burst_ = per_second, rate_limit_key key_ = rate_limit_key::global, boost::beast::http::field header_ = boost::beast::http::field::unknown>
+struct rate_limit : rate_limit_policy
+{
+	static_assert(per_second > 0 && burst_ > 0, "rate_limit needs a positive rate and burst");
+	static_assert(key_ != rate_limit_key::header || header_ != boost::beast::http::field::unknown, "header keyed rate_limit needs a header");
+
+	static constexpr int64_t interval_ns{ std::max<int64_t>(1'000'000'000 / per_second, 1) };
+	static constexpr int64_t burst_ns{ interval_ns * burst_ };
+	static constexpr rate_limit_key key{ key_ };
+	static constexpr boost::beast::http::field header{ header_ };
+};
+
+// Token bucket in GCRA form: the whole bucket state is one theoretical arrival time, so taking a
+// token is a single CAS. An idle bucket (tat in the past) behaves exactly like a fresh one.
+struct token_bucket
+{
+	std::atomic<int64_t> tat{};
+
+	bool try_acquire(int64_t now, int64_t interval, int64_t burst) noexcept
+	{
+		auto current{ tat.load(std::memory_order_relaxed) };
+		for (;;)
+		{
+			auto next{ std::max(current, now) + interval };
+			if (next - now > burst)
+				return false;
+			if (tat.compare_exchange_weak(current, next, std::memory_order_relaxed))
+				return true;
+		}
+	}
+
+	bool idle(int64_t now) const noexcept
+	{
+		return tat.load(std::memory_order_relaxed) <= now;
+	}
+};
+
+// Fixed-size open addressed table of buckets keyed by a 64-bit hash. Slots are claimed and
+// recycled with a CAS on the key; when every probed slot is busy the key shares the home slot,
+// which errs on the side of limiting harder.
+class rate_limit_table
+{
+	// Key value of a free slot. A key that mixes to it is stored as `substitute_key` instead and
+	// shares its bucket with the (equally unlikely) key mixing to that.
+	static constexpr uint64_t free_key{ 0 };
+	static constexpr uint64_t substitute_key{ ~0ull };
+
+	static constexpr size_t shard_count{ 16 };
+	static constexpr size_t slots_per_shard{ 1024 };
+	static constexpr size_t probe_length{ 4 };
+
+	struct slot
+	{
+		std::atomic<uint64_t> key{};
+		token_bucket bucket;
+	};
+
+	struct alignas(64) shard
+	{
+		std::array<slot, slots_per_shard> slots;
+	};
+
+	std::array<shard, shard_count> m_shards;
+
+	// splitmix64 finalizer. Callers pass hashes that may be the identity (std::hash of an IPv4
+	// address is), so the shard comes from the high and the slot from the low bits of the mix.
+	static constexpr uint64_t mix(uint64_t x) noexcept
+	{
+		x += 0x9e3779b97f4a7c15ull;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+		return x ^ (x >> 31);
+	}
+
+public:
+	bool try_acquire(uint64_t hash, int64_t now, int64_t interval, int64_t burst) noexcept
+	{
+		auto key{ mix(hash) };
+		auto& sh{ m_shards[(key >> 32) % shard_count] };
+		auto home{ key % slots_per_shard };
+		if (key == free_key)
+			key = substitute_key;
+
+		for (size_t i{}; i < probe_length; ++i)
+		{
+			auto& s{ sh.slots[(home + i) % slots_per_shard] };
+			auto current{ s.key.load(std::memory_order_acquire) };
+			if (current == key)
+				return s.bucket.try_acquire(now, interval, burst);
+			if ((current == free_key || s.bucket.idle(now)) && s.key.compare_exchange_strong(current, key, std::memory_order_acq_rel))
+				return s.bucket.try_acquire(now, interval, burst);
+		}
+		return sh.slots[home].bucket.try_acquire(now, interval, burst);
+	}
+};
+
+// Bucket state of one endpoint; `route` keeps endpoints with identical limits apart.
+template<auto route, typename limit>
+struct route_rate_limiter
+{
+	static inline token_bucket global;
+	static inline rate_limit_table keyed;
+
+	static uint64_t hash_address(const boost::asio::ip::address& address)
+	{
+		if (address.is_v4())
+			return std::hash<uint32_t>{}(address.to_v4().to_uint());
+		auto bytes{ address.to_v6().to_bytes() };
+		return std::hash<std::string_view>{}({ reinterpret_cast<const char*>(bytes.data()), bytes.size() });
+	}
+
+	static bool try_acquire(const request& req, const boost::asio::ip::address* peer)
+	{
+		auto now{ std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() };
+		if constexpr (limit::key == rate_limit_key::global)
+			return global.try_acquire(now, limit::interval_ns, limit::burst_ns);
+		else if constexpr (limit::key == rate_limit_key::client_ip)
+			return keyed.try_acquire(peer ? hash_address(*peer) : 0, now, limit::interval_ns, limit::burst_ns);
+		else
+		{
+			auto value{ req[limit::header] };
+			return keyed.try_acquire(std::hash<std::string_view>{}({ value.data(), value.size() }), now, limit::interval_ns, limit::burst_ns);
+		}
+	}
+};
+
+// 429 for the request's version and keep-alive setting.
+inline response rate_limited_response(const request& req)
+{
+	static const canned_response too_many_requests{ boost::beast::http::status::too_many_requests, "too many requests\n",
+		{ { boost::beast::http::field::retry_after, "1" } } };
+	return too_many_requests(req);
+}
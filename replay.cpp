@@ -0,0 +1,240 @@
+#include "includes.h"
+#include "defs.h"
+#include "url_router.h"
+#include "server.h"
+#include "capture.h"
+#include "load_client.h"
+#include "load_endpoints.h"
+
+// Replays a URL_ROUTER_CAPTURE file in capture order, either straight through load_router::route
+// on one thread (routing cost only) or over loopback to load_server (the whole server). Identical
+// captured requests are prepared once and replayed by index.
+
+struct options
+{
+	std::string capture;
+	bool loopback{};
+	unsigned iterations{ 1 };
+	uint16_t port{ 34542 };
+	unsigned connections{ 16 };
+	unsigned pipeline_depth{ 1 };
+	std::chrono::seconds duration{ 10 };
+	uint64_t min_requests{};
+};
+
+static void usage()
+{
+	std::println("usage: url_router_replay CAPTURE [--loopback] [--iterations N]");
+	std::println("                         [--port N] [--connections N] [--pipeline N] [--duration S] [--min-requests N]");
+	std::println("in-process replay runs the capture --iterations times, --loopback replays it for --duration");
+	std::println("--min-requests fails the run (exit code 3) when fewer requests completed");
+}
+
+static std::optional<options> parse_options(int argc, char** argv)
+{
+	if (argc < 2)
+		return std::nullopt;
+
+	options opts;
+	opts.capture = argv[1];
+	for (int i{ 2 }; i < argc; ++i)
+	{
+		std::string_view arg{ argv[i] };
+		if (arg == "--loopback")
+		{
+			opts.loopback = true;
+			continue;
+		}
+		if (arg == "--help" || i + 1 == argc)
+			return std::nullopt;
+
+		std::string_view value{ argv[++i] };
+		unsigned n{};
+		if (auto [_, ec] { std::from_chars(value.data(), value.data() + value.size(), n) }; ec != std::errc{})
+			throw std::runtime_error{ std::format("bad value for {}: {}", arg, value) };
+
+		if (arg == "--iterations")
+			opts.iterations = std::max(n, 1u);
+		else if (arg == "--port")
+			opts.port = static_cast<uint16_t>(n);
+		else if (arg == "--connections")
+			opts.connections = std::max(n, 1u);
+		else if (arg == "--pipeline")
+			opts.pipeline_depth = std::max(n, 1u);
+		else if (arg == "--duration")
+			opts.duration = std::chrono::seconds{ n };
+		else if (arg == "--min-requests")
+			opts.min_requests = n;
+		else
+			return std::nullopt;
+	}
+	return opts;
+}
+
+// Distinct captured requests, and the capture as indices into them.
+struct replay_set
+{
+	std::vector<traffic_capture::entry> requests;
+	std::vector<unsigned> weights;
+	std::vector<size_t> order;
+};
+
+static replay_set deduplicate(const std::vector<traffic_capture::entry>& entries)
+{
+	replay_set set;
+	std::unordered_map<std::string, size_t> index;
+	std::string key;
+	for (auto& e : entries)
+	{
+		key.clear();
+		traffic_capture::append_raw(key, static_cast<uint16_t>(e.method));
+		traffic_capture::append_raw(key, static_cast<uint32_t>(e.target.size()));
+		key += e.target;
+		for (auto& [field, value] : e.headers)
+		{
+			traffic_capture::append_raw(key, static_cast<uint16_t>(field));
+			traffic_capture::append_raw(key, static_cast<uint32_t>(value.size()));
+			key += value;
+		}
+
+		auto [i, inserted] { index.try_emplace(key, set.requests.size()) };
+		if (inserted)
+		{
+			set.requests.push_back(e);
+			set.weights.push_back(0);
+		}
+		++set.weights[i->second];
+		set.order.push_back(i->second);
+	}
+	return set;
+}
+
+static void print_summary(const latency_histogram& latencies, uint64_t non_2xx, std::chrono::duration<double> elapsed)
+{
+	auto us{ [](uint64_t ns) { return ns / 1000.0; } };
+	std::println("{} requests in {:.2f}s, {:.0f} req/s, p50 {:.2f} us, p99 {:.2f} us, p99.9 {:.2f} us, max {:.2f} us, non-2xx {}",
+		latencies.count(), elapsed.count(), latencies.count() / elapsed.count(), us(latencies.value_at_percentile(50)),
+		us(latencies.value_at_percentile(99)), us(latencies.value_at_percentile(99.9)), us(latencies.max()), non_2xx);
+}
+
+// Requests are built up front; each replayed one is copied into a reused request, since the
+// router works on it in place. Only the route call itself is timed.
+static uint64_t replay_in_process(const replay_set& set, unsigned iterations)
+{
+	std::vector<request> requests;
+	requests.reserve(set.requests.size());
+	for (auto& e : set.requests)
+	{
+		auto& req{ requests.emplace_back(e.method, std::string{ e.target }, 11) };
+		for (auto& [field, value] : e.headers)
+			req.set(field, value);
+	}
+
+	asio::io_context ctx{ 1 };
+	load_router router;
+	latency_histogram latencies;
+	uint64_t non_2xx{};
+
+	auto start{ std::chrono::steady_clock::now() };
+	co_spawn(ctx, [&]() -> asio::awaitable<void> {
+		request req;
+		for (unsigned i{}; i < iterations; ++i)
+			for (auto captured : set.order)
+			{
+				req = requests[captured];
+				auto begin{ std::chrono::steady_clock::now() };
+				auto resp{ co_await router.route(req, &ctx) };
+				latencies.record(std::chrono::steady_clock::now() - begin);
+				if (resp.result_int() / 100 != 2)
+					++non_2xx;
+			}
+	}, detached);
+	ctx.run();
+	std::chrono::duration<double> elapsed{ std::chrono::steady_clock::now() - start };
+
+	print_summary(latencies, non_2xx, elapsed);
+	return latencies.count();
+}
+
+// Every connection walks the capture in order from its own evenly spaced starting point.
+static uint64_t replay_loopback(const options& opts, const replay_set& set)
+{
+	load_plan plan;
+	plan.pipeline_depth = opts.pipeline_depth;
+	for (size_t i{}; i < set.requests.size(); ++i)
+		plan.add_target(std::string{ set.requests[i].target }, set.weights[i], set.requests[i].method, {}, set.requests[i].headers);
+	plan.schedule = set.order;
+
+	asio::io_context server_ctx{ 1 };
+	load_server server{ server_ctx, opts.port, asio::ip::address_v4::loopback() };
+	std::jthread server_thread{ [&] { server_ctx.run(); } };
+
+	asio::io_context ctx{ 1 };
+	load_stats stats{ plan.targets.size() };
+	auto until{ std::chrono::steady_clock::now() + opts.duration };
+	for (unsigned i{}; i < opts.connections; ++i)
+	{
+		tcp::socket socket{ ctx };
+		socket.connect(tcp::endpoint{ asio::ip::address_v4::loopback(), opts.port });
+		socket.set_option(tcp::no_delay{ true });
+		co_spawn(ctx, run_load_connection(std::move(socket), plan, stats, plan.schedule.size() * i / opts.connections, until), detached);
+	}
+
+	auto start{ std::chrono::steady_clock::now() };
+	ctx.run();
+	std::chrono::duration<double> elapsed{ std::chrono::steady_clock::now() - start };
+	server_ctx.stop();
+
+	latency_histogram latencies;
+	uint64_t non_2xx{};
+	for (size_t i{}; i < plan.targets.size(); ++i)
+	{
+		latencies.merge(stats.latencies[i]);
+		non_2xx += stats.non_2xx[i];
+	}
+	print_summary(latencies, non_2xx, elapsed);
+	if (stats.errors)
+		std::println("connection errors: {}", stats.errors);
+	return latencies.count();
+}
+
+int main(int argc, char** argv)
+{
+	std::optional<options> opts;
+	try {
+		opts = parse_options(argc, argv);
+	}
+	catch (std::exception& ex)
+	{
+		std::println(stderr, "{}", ex.what());
+	}
+	if (!opts)
+	{
+		usage();
+		return 1;
+	}
+
+	try {
+		traffic_capture::mapped_file file{ opts->capture };
+		std::vector<traffic_capture::entry> entries;
+		if (!traffic_capture::for_each_entry(file.data(), [&](const traffic_capture::entry& e) { entries.push_back(e); }))
+			std::println(stderr, "{}: not a capture or truncated, replaying the {} complete records", opts->capture, entries.size());
+		if (entries.empty())
+			return 1;
+		auto set{ deduplicate(entries) };
+		std::println("{} captured requests, {} distinct", entries.size(), set.requests.size());
+
+		auto completed{ opts->loopback ? replay_loopback(*opts, set) : replay_in_process(set, opts->iterations) };
+		if (completed < opts->min_requests)
+		{
+			std::println(stderr, "only {} requests completed, expected at least {}", completed, opts->min_requests);
+			return 3;
+		}
+	}
+	catch (std::exception& ex)
+	{
+		std::println(stderr, "replay failed: {}", ex.what());
+		return 1;
+	}
+	return 0;
+}
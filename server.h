@@ -2,38 +2,357 @@
 #include "includes.h"
 #include "defs.h"
 #include "url_router.h"
+#include "timer_wheel.h"
+#include "capture.h"
+
+using reroute_t = basic_reroute_t<boost::asio::awaitable<boost::beast::http::response<shared_text_body>>>;
+
+struct server_metrics
+{
+	// Requests whose handler was cancelled because the client went away before the response.
+	std::atomic<uint64_t> cancelled_requests{};
+};
 
-using reroute_t = basic_reroute_t<boost::asio::awaitable<boost::beast::http::response<boost::beast::http::string_body>>>;
 template<Router router>
 struct http_server
 {
 	asio::io_context& m_ctx;
 	uint16_t m_port;
 	asio::ip::address m_address{};
+	timer_wheel& m_wheel;
+
+	// Connection deadlines: waiting for (and reading) the next request, and handling plus
+	// writing the response once it has been read.
+	timer_wheel::clock::duration m_idle_timeout{ 60s };
+	timer_wheel::clock::duration m_request_timeout{ 30s };
+
+	// Capacity a connection keeps in its read buffer and request body between keep-alive
+	// requests; anything beyond it is released once the request is done.
+	size_t m_retained_capacity{ 64 * 1024 };
+
+	// Largest request body accepted by endpoints without a body_limit policy.
+	uint64_t m_body_limit{ 1024 * 1024 };
+
+	// Largest message a WebSocket session reads, and the bytes of outgoing messages it queues
+	// before ws_channel::send starts dropping them.
+	size_t m_websocket_message_limit{ 64 * 1024 };
+	size_t m_websocket_queue_limit{ 1024 * 1024 };
 
 	router m_router;
+	server_metrics m_metrics;
+
+	// Servers on other event loop threads that this server's listeners hand accepted connections
+	// to, in turn with itself. Each runs its connections on its own io_context and timer wheel.
+	std::vector<http_server*> m_accept_peers;
+	size_t m_next_peer{};
+
+	using resolved_request = typename router::resolved_request;
+
+	asio::awaitable<response> process_request(resolved_request& resolved, tracing::request_trace* trace, peer_info* peer, access_logging::matched_route* match, websocket_upgrade* upgrade = nullptr)
+	{
+		co_return co_await m_router.route(resolved, this, &m_ctx, &m_wheel, trace, peer, match, upgrade);
+	}
+
+	// Empties the request for the next read on the connection, keeping the body's capacity up to
+	// m_retained_capacity. Header fields are individually allocated by beast and go with it.
+	void reset_request(request& req)
+	{
+		req.base() = http::request_header<>{};
+		if (req.body().capacity() > m_retained_capacity)
+			std::string{}.swap(req.body());
+		else
+			req.body().clear();
+	}
+
+	// Requests turned away from their head alone get canned responses (see canned_response);
+	// the ones without keep-alive go out when the request body is left unread.
+	static const canned_response& payload_too_large()
+	{
+		static const canned_response r{ http::status::payload_too_large, "payload too large\n" };
+		return r;
+	}
+
+	// 405 carries the methods the path does accept, so it is the one early response built per request.
+	static std::string method_not_allowed_response(verb_mask allowed, unsigned version, bool keep_alive)
+	{
+		std::string allow;
+		for (auto i{ static_cast<unsigned>(http::verb::delete_) }; i <= static_cast<unsigned>(http::verb::unlink); ++i)
+			if (allowed & static_cast<http::verb>(i))
+			{
+				auto name{ http::to_string(static_cast<http::verb>(i)) };
+				if (!allow.empty())
+					allow += ", ";
+				allow.append(name.data(), name.size());
+			}
+		return serialize_response(text_response(http::status::method_not_allowed, "method not allowed\n", version, keep_alive,
+			{ { http::field::allow, allow } }));
+	}
 
-	asio::awaitable<response> process_request(request req)
+	static asio::ip::address peer_address(tcp::socket& socket)
 	{
-		auto tgt{ req.target() };
-		co_return co_await m_router.route(std::move(req), this, &m_ctx);
+		return socket.remote_endpoint().address();
 	}
 
-	asio::awaitable<void> run_connection(tcp::socket socket)
+	// Local stream sockets have no network peer; their peer address stays unspecified, which
+	// puts all of them in one client_ip rate limit bucket.
+	template<typename socket_type>
+	static asio::ip::address peer_address(socket_type&)
 	{
+		return {};
+	}
+
+	// Runs the handler to its outcome: the response, or what it threw. Either ends the race with
+	// watch_peer_close at once; the exception is rethrown once the race is over.
+	asio::awaitable<std::pair<std::exception_ptr, response>> settle_request(resolved_request& resolved, tracing::request_trace* trace, peer_info* peer, access_logging::matched_route* match)
+	{
+		std::exception_ptr error;
+		try {
+			co_return std::pair{ std::exception_ptr{}, co_await process_request(resolved, trace, peer, match) };
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+		co_return std::pair{ error, response{} };
+	}
+
+	// Completes only when the peer leaves while a request is in flight: it resets the connection,
+	// or closes it (end of stream) without anything pipelined behind the request. A peer that
+	// already sent more is assumed to still want the responses, so watching stops there, as it
+	// does when the wait itself fails (the connection's own deadline closed the socket); the
+	// watcher then just waits to be cancelled.
+	template<typename socket_type>
+	asio::awaitable<void> watch_peer_close(socket_type& socket, bool pipelined)
+	{
+		socket.non_blocking(true);
+		for (;;)
+		{
+			auto [ec] { co_await socket.async_wait(socket_type::wait_read, asio::as_tuple(use_awaitable)) };
+			if (ec)
+				break;
+
+			std::array<char, 1> probe;
+			socket.receive(asio::buffer(probe), socket_type::message_peek, ec);
+			if (ec == asio::error::would_block)
+				continue;
+			if (ec && !(ec == asio::error::eof && pipelined))
+				co_return;
+			break;
+		}
+
+		asio::steady_timer never{ socket.get_executor(), asio::steady_timer::time_point::max() };
+		co_await never.async_wait(use_awaitable);
+	}
+
+	template<typename socket_type>
+	asio::awaitable<void> run_connection(socket_type socket)
+	{
+		// Message state lives for the whole connection and is reset between requests, so
+		// keep-alive traffic reuses the buffer, body and parser/serializer storage. A request
+		// stays in its parser until the next one is read: it is resolved from the head and
+		// then routed where it is.
 		beast::flat_buffer buffer;
+		request recycled;
+		response resp;
+		std::optional<http::request_parser<http::string_body>> parser;
+		std::optional<http::serializer<false, response::body_type>> serializer;
+		timer_wheel::deadline timeout{ m_wheel, [&socket] {
+			boost::system::error_code ec;
+			socket.close(ec);
+		} };
+
+		auto& access_log{ access_logging::logger::instance() };
+		auto& capture{ traffic_capture::recorder::instance() };
+
 		try {
+			peer_info peer{ peer_address(socket) };
 			for (;;)
 			{
-				request req;
-				co_await http::async_read(socket, buffer, req, use_awaitable);
+				timeout.arm(m_idle_timeout);
+				auto trace{ tracing::tracer::instance().begin_request() };
+
+				// Keep-alive idle time is not part of the request; wait for the first byte before
+				// starting the spans of a sampled request.
+				if (trace.sampled && !buffer.size())
+					co_await socket.async_wait(socket_type::wait_read, use_awaitable);
+				tracing::span whole{ &trace, "request" };
 
-				auto resp{ co_await process_request(std::move(req)) };
+				// The head is routed before the body is read: requests that would be turned away
+				// get a canned response without their body ever being received.
+				access_logging::record entry;
+				bool logged{ access_log.enabled() };
+				std::string rejection_storage;
+				std::string_view rejection;
+				unsigned rejection_status{};
+				bool close{};
+				resolved_request resolved;
+				{
+					tracing::span read{ &trace, "read" };
+					if (parser)
+						recycled = parser->release();
+					reset_request(recycled);
+					parser.emplace(std::move(recycled));
+					parser->body_limit(boost::none);
+					entry.bytes_in = co_await http::async_read_header(socket, buffer, *parser, use_awaitable);
+				}
 
-				http::serializer<false, response::body_type> sr{ resp };
-				co_await http::async_write(socket, sr, use_awaitable);
+				auto& head{ parser->get() };
+				auto& resolution{ m_router.resolve(head, resolved, &trace) };
+				auto limit{ resolution.body_limit.value_or(m_body_limit) };
+				auto version{ head.version() };
+				close = !parser->is_done() || !head.keep_alive();
+				switch (resolution.status)
+				{
+				case route_resolution::status_t::bad_url:
+					rejection = canned_error(route_error::bad_url).wire(version, !close);
+					rejection_status = 400;
+					break;
+				case route_resolution::status_t::not_found:
+					rejection = canned_error(route_error::no_route).wire(version, !close);
+					rejection_status = 404;
+					break;
+				case route_resolution::status_t::method_not_allowed:
+					rejection_storage = method_not_allowed_response(resolution.allowed, version, !close);
+					rejection = rejection_storage;
+					rejection_status = 405;
+					break;
+				case route_resolution::status_t::ok:
+					if (auto length{ parser->content_length() }; length && *length > limit)
+					{
+						rejection = payload_too_large().wire(version, !close);
+						rejection_status = 413;
+					}
+					break;
+				}
+
+				if (rejection.empty() && !parser->is_done())
+				{
+					tracing::span read_body{ &trace, "read_body" };
+
+					// HTTP/1.0 clients do not know interim responses.
+					if (version >= 11 && beast::iequals(head[http::field::expect], "100-continue"))
+						co_await asio::async_write(socket, asio::buffer("HTTP/1.1 100 Continue\r\n\r\n"sv), use_awaitable);
+
+					// Chunked bodies only reveal their size while they are read.
+					parser->body_limit(limit);
+					auto [ec, bytes] { co_await http::async_read(socket, buffer, *parser, asio::as_tuple(use_awaitable)) };
+					entry.bytes_in += bytes;
+					if (ec == http::error::body_limit)
+					{
+						close = true;
+						rejection = payload_too_large().wire(version, false);
+						rejection_status = 413;
+					}
+					else if (ec)
+						throw boost::system::system_error{ ec };
+				}
+				auto& req{ parser->get() };
+				if (capture.enabled())
+					capture.record(req);
+
+				if (!rejection.empty())
+				{
+					tracing::span write{ &trace, "write" };
+					auto bytes_out{ co_await asio::async_write(socket, asio::buffer(rejection), use_awaitable) };
+					if (logged)
+					{
+						entry.received = std::chrono::system_clock::now();
+						entry.peer = peer.address;
+						entry.method = req.method();
+						entry.status = rejection_status;
+						entry.bytes_out = bytes_out;
+						access_log.log(entry);
+					}
+					if (close)
+						break;
+					continue;
+				}
+
+				std::chrono::steady_clock::time_point handle_begin;
+				if (logged)
+				{
+					entry.received = std::chrono::system_clock::now();
+					entry.peer = peer.address;
+					entry.method = req.method();
+					handle_begin = std::chrono::steady_clock::now();
+				}
+				access_logging::matched_route match;
+
+				// Upgrade requests resolved to a websocket endpoint are offered the connection, with
+				// whatever the client sent behind the request; the endpoint runs its whole session
+				// here and returns websocket_closed(). The peer watcher would race the session's own
+				// reads, so these requests go without it. Other upgrade requests are plain ones.
+				timeout.arm(m_request_timeout);
+				if (resolved.resolution().websocket && beast::websocket::is_upgrade(req))
+				{
+					websocket_connection<socket_type> upgrade{ socket, buffer, timeout, m_websocket_message_limit, m_websocket_queue_limit };
+					resp = co_await process_request(resolved, &trace, &peer, &match, &upgrade);
+					if (resp.result() == http::status::switching_protocols)
+					{
+						if (logged)
+						{
+							entry.route = match.route;
+							entry.status = resp.result_int();
+							entry.handle_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - handle_begin);
+							access_log.log(entry);
+						}
+						// The session has already shut the socket down.
+						co_return;
+					}
+				}
+				else
+				{
+					// Losing the race to watch_peer_close cancels the handler through the
+					// cancellation slots of everything it is suspended on.
+					using namespace asio::experimental::awaitable_operators;
+					auto outcome{ co_await (settle_request(resolved, &trace, &peer, &match) || watch_peer_close(socket, buffer.size() != 0)) };
+					if (outcome.index() == 1)
+					{
+						m_metrics.cancelled_requests.fetch_add(1, std::memory_order_relaxed);
+						if (logged)
+						{
+							// 499 as in nginx: the client closed the connection before the response.
+							entry.route = match.route;
+							entry.status = 499;
+							entry.handle_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - handle_begin);
+							access_log.log(entry);
+						}
+						break;
+					}
+					auto& [error, handled]{ std::get<0>(outcome) };
+					if (error)
+						std::rethrow_exception(error);
+					resp = std::move(handled);
+				}
+
+				// Handlers only set status and body: the connection stays open if the client asked
+				// for that and the handler did not close it, and the body length is framed here.
+				resp.keep_alive(resp.keep_alive() && req.keep_alive());
+				resp.prepare_payload();
+
+				std::chrono::steady_clock::time_point write_begin;
+				if (logged)
+					write_begin = std::chrono::steady_clock::now();
+				{
+					tracing::span write{ &trace, "write" };
+					serializer.emplace(resp);
+					entry.bytes_out = co_await http::async_write(socket, *serializer, use_awaitable);
+					serializer.reset();
+				}
+				if (logged)
+				{
+					auto write_end{ std::chrono::steady_clock::now() };
+					entry.route = match.route;
+					entry.status = resp.result_int();
+					entry.handle_time = std::chrono::duration_cast<std::chrono::microseconds>(write_begin - handle_begin);
+					entry.write_time = std::chrono::duration_cast<std::chrono::microseconds>(write_end - write_begin);
+					access_log.log(entry);
+				}
 				if (resp.need_eof())
 					break;
+
+				if (!buffer.size() && buffer.capacity() > m_retained_capacity)
+					buffer.shrink_to_fit();
 			}
 			socket.shutdown(asio::socket_base::shutdown_both);
 		}
@@ -46,9 +365,14 @@ struct http_server
 	}
 
 	http_server(asio::io_context& ctx, uint16_t port, asio::ip::address address = {})
-		: m_ctx{ ctx }, m_port{ port }, m_address{ address }
+		: m_ctx{ ctx }, m_port{ port }, m_address{ address }, m_wheel{ asio::use_service<timer_wheel>(ctx) }
 	{}
 
+	const server_metrics& metrics() const
+	{
+		return m_metrics;
+	}
+
 	virtual void handle_client_error(std::exception& ex)
 	{
 	}
@@ -56,16 +380,119 @@ struct http_server
 	virtual ~http_server()
 	{}
 
-	asio::awaitable<void> run_server_async()
+	// Lets `peer`, a server with the same routes running on another thread's io_context, take a
+	// share of the connections this server accepts. Must be called before the listeners run.
+	void share_accepts(http_server& peer)
 	{
-		tcp::acceptor acceptor{ m_ctx, tcp::endpoint{ m_address, m_port } };
+		m_accept_peers.push_back(&peer);
+	}
 
+	template<typename acceptor_type>
+	asio::awaitable<void> accept_loop(acceptor_type acceptor)
+	{
 		for (;;)
 		{
-			auto client_socket{ co_await acceptor.async_accept(m_ctx, use_awaitable) };
-			co_spawn(m_ctx, run_connection(std::move(client_socket)), detached);
+			auto& server{ m_next_peer ? *m_accept_peers[m_next_peer - 1] : *this };
+			m_next_peer = (m_next_peer + 1) % (m_accept_peers.size() + 1);
+			auto client_socket{ co_await acceptor.async_accept(server.m_ctx, use_awaitable) };
+			co_spawn(server.m_ctx, server.run_connection(std::move(client_socket)), detached);
+		}
+	}
+
+	asio::awaitable<void> run_server_async()
+	{
+		co_await accept_loop(tcp::acceptor{ m_ctx, tcp::endpoint{ m_address, m_port } });
+	}
+
+	// Binds the TCP listener before returning, so clients may connect as soon as this returns;
+	// connections wait in the listen queue until the io_context runs. Bind errors are thrown to
+	// the caller.
+	void listen_tcp()
+	{
+		co_spawn(m_ctx, accept_loop(tcp::acceptor{ m_ctx, tcp::endpoint{ m_address, m_port } }), detached);
+	}
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+	// Accepts connections on a Unix domain stream socket at `path`. A socket file left behind by
+	// a previous run (nothing accepts on it, so connecting is refused) is replaced; a socket a live
+	// server listens on, or anything that is not a socket, is left alone and the call throws, as it
+	// does for bind errors.
+	void listen_unix(const std::string& path)
+	{
+		asio::local::stream_protocol::endpoint endpoint{ path };
+#if !defined(_WIN32)
+		struct stat existing{};
+		if (!::lstat(path.c_str(), &existing))
+		{
+			if (!S_ISSOCK(existing.st_mode))
+				throw boost::system::system_error{ std::make_error_code(std::errc::file_exists), std::format("listen_unix: {} is not a socket", path) };
+			asio::local::stream_protocol::socket probe{ m_ctx };
+			boost::system::error_code ec;
+			probe.connect(endpoint, ec);
+			if (!ec)
+				ec = asio::error::address_in_use;
+			if (ec != asio::error::connection_refused)
+				throw boost::system::system_error{ ec, std::format("listen_unix: {} is in use", path) };
+			::unlink(path.c_str());
 		}
+#endif
+		asio::local::stream_protocol::acceptor acceptor{ m_ctx, endpoint };
+		co_spawn(m_ctx, accept_loop(std::move(acceptor)), detached);
+	}
+
+	// Listens on an already bound and listening descriptor, which the server owns from here on:
+	// it is closed if it cannot be used.
+	void listen_fd(int fd)
+	{
+		auto adopt{ [&](auto& acceptor, auto protocol) {
+			boost::system::error_code ec;
+			acceptor.assign(protocol, fd, ec);
+			if (ec)
+			{
+				::close(fd);
+				throw boost::system::system_error{ ec, "listen_fd" };
+			}
+			co_spawn(m_ctx, accept_loop(std::move(acceptor)), detached);
+		} };
+
+		sockaddr_storage address{};
+		socklen_t length{ sizeof(address) };
+		if (::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length))
+		{
+			boost::system::system_error error{ errno, boost::system::system_category(), "getsockname" };
+			::close(fd);
+			throw error;
+		}
+
+		if (address.ss_family == AF_UNIX)
+		{
+			asio::local::stream_protocol::acceptor acceptor{ m_ctx };
+			adopt(acceptor, asio::local::stream_protocol{});
+		}
+		else
+		{
+			tcp::acceptor acceptor{ m_ctx };
+			adopt(acceptor, address.ss_family == AF_INET6 ? tcp::v6() : tcp::v4());
+		}
+	}
+
+	// Socket activation: listens on the descriptors passed through LISTEN_FDS/LISTEN_PID (they
+	// start at fd 3) and returns how many there were.
+	size_t listen_inherited()
+	{
+		auto pid{ std::getenv("LISTEN_PID") };
+		auto fds{ std::getenv("LISTEN_FDS") };
+		if (!pid || !fds || std::strtol(pid, nullptr, 10) != ::getpid())
+			return 0;
+
+		auto count{ std::strtoul(fds, nullptr, 10) };
+		for (unsigned long i{}; i < count; ++i)
+			listen_fd(3 + static_cast<int>(i));
+		::unsetenv("LISTEN_PID");
+		::unsetenv("LISTEN_FDS");
+		return count;
 	}
+#endif
 };
 
 template<auto... routes>
@@ -75,6 +502,6 @@ struct simple_http_server : http_server<router_t<routes...>>
 	simple_http_server(asio::io_context& ctx, uint16_t port, asio::ip::address address = {})
 		: base{ ctx, port, address }
 	{
-		co_spawn(ctx, base::run_server_async(), detached);
+		base::listen_tcp();
 	}
 };
@@ -0,0 +1,117 @@
+#pragma once
+#include "includes.h"
+
+// Immutable text shared between copies: copying a response that carries it copies a pointer, so
+// coalesced requests and prebuilt responses hand one body to every receiver.
+class shared_text
+{
+	std::shared_ptr<const std::string> m_text;
+
+public:
+	shared_text() = default;
+
+	shared_text(std::string text) : m_text{ std::make_shared<const std::string>(std::move(text)) } {}
+
+	shared_text(const char* text) : shared_text{ std::string{ text } } {}
+
+	shared_text(std::string_view text) : shared_text{ std::string{ text } } {}
+
+	std::string_view view() const noexcept
+	{
+		return m_text ? std::string_view{ *m_text } : std::string_view{};
+	}
+
+	operator std::string_view() const noexcept
+	{
+		return view();
+	}
+
+	const char* data() const noexcept
+	{
+		return view().data();
+	}
+
+	size_t size() const noexcept
+	{
+		return m_text ? m_text->size() : 0;
+	}
+
+	bool empty() const noexcept
+	{
+		return !size();
+	}
+};
+
+// Beast body holding shared_text. Writing sends the shared bytes as they are; reading collects
+// the body into a string of its own and shares it once the message is complete.
+struct shared_text_body
+{
+	using value_type = shared_text;
+
+	static uint64_t size(const value_type& body)
+	{
+		return body.size();
+	}
+
+	class writer
+	{
+		const value_type& m_body;
+
+	public:
+		using const_buffers_type = boost::asio::const_buffer;
+
+		template<bool is_request, typename fields>
+		writer(const boost::beast::http::header<is_request, fields>&, const value_type& body) : m_body{ body } {}
+
+		void init(boost::beast::error_code& ec)
+		{
+			ec = {};
+		}
+
+		boost::optional<std::pair<const_buffers_type, bool>> get(boost::beast::error_code& ec)
+		{
+			ec = {};
+			return { { const_buffers_type{ m_body.data(), m_body.size() }, false } };
+		}
+	};
+
+	class reader
+	{
+		value_type& m_body;
+		std::string m_text;
+
+	public:
+		template<bool is_request, typename fields>
+		reader(boost::beast::http::header<is_request, fields>&, value_type& body) : m_body{ body } {}
+
+		void init(const boost::optional<uint64_t>& length, boost::beast::error_code& ec)
+		{
+			ec = {};
+			if (length)
+			{
+				if (*length > m_text.max_size())
+				{
+					ec = boost::beast::http::error::buffer_overflow;
+					return;
+				}
+				m_text.reserve(static_cast<size_t>(*length));
+			}
+		}
+
+		template<typename const_buffer_sequence>
+		size_t put(const const_buffer_sequence& buffers, boost::beast::error_code& ec)
+		{
+			ec = {};
+			auto size{ boost::asio::buffer_size(buffers) };
+			auto offset{ m_text.size() };
+			m_text.resize(offset + size);
+			return boost::asio::buffer_copy(boost::asio::buffer(m_text.data() + offset, size), buffers);
+		}
+
+		void finish(boost::beast::error_code& ec)
+		{
+			ec = {};
+			m_body = shared_text{ std::move(m_text) };
+		}
+	};
+};
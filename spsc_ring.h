@@ -0,0 +1,39 @@
+#pragma once
+#include "includes.h"
+
+// Bounded single-producer/single-consumer ring. The owning thread pushes, one background thread
+// drains; neither side ever blocks, a full ring simply rejects the push.
+template<typename T, size_t capacity_>
+class spsc_ring
+{
+	static_assert(std::has_single_bit(capacity_), "spsc_ring capacity must be a power of two");
+	static constexpr size_t mask{ capacity_ - 1 };
+
+	alignas(64) std::atomic<size_t> m_tail{};
+	alignas(64) std::atomic<size_t> m_head{};
+	std::array<T, capacity_> m_items{};
+
+public:
+	static constexpr size_t capacity{ capacity_ };
+
+	bool try_push(const T& item) noexcept
+	{
+		auto tail{ m_tail.load(std::memory_order_relaxed) };
+		if (tail - m_head.load(std::memory_order_acquire) == capacity_)
+			return false;
+		m_items[tail & mask] = item;
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	template<typename F>
+	size_t consume_all(F&& f)
+	{
+		auto head{ m_head.load(std::memory_order_relaxed) };
+		auto tail{ m_tail.load(std::memory_order_acquire) };
+		for (auto i{ head }; i != tail; ++i)
+			f(m_items[i & mask]);
+		m_head.store(tail, std::memory_order_release);
+		return tail - head;
+	}
+};
@@ -0,0 +1,54 @@
+#include "check.h"
+#include "defs.h"
+#include "capture.h"
+
+constexpr unsigned threads{ 4 };
+constexpr unsigned requests_per_thread{ 500 };
+
+// Heads recorded from several threads at once all come back, each thread's in the order it
+// recorded them, with the selected headers and without the others. The capture is left in
+// `path` for the replay smoke test.
+static void records_from_all_threads(const std::string& path)
+{
+	auto& recorder{ traffic_capture::recorder::instance() };
+	recorder.enable(path, { http::field::host, http::field::accept }, 5ms);
+	{
+		std::vector<std::jthread> producers;
+		for (unsigned t{}; t < threads; ++t)
+			producers.emplace_back([t] {
+				for (unsigned i{}; i < requests_per_thread; ++i)
+				{
+					request req{ i % 2 ? http::verb::get : http::verb::post, std::format("/item/{}?t={}", i, t), 11 };
+					req.set(http::field::host, "127.0.0.1");
+					req.set(http::field::user_agent, "capture_test");
+					if (i % 3 == 0)
+						req.set(http::field::accept, "text/plain");
+					traffic_capture::recorder::instance().record(req);
+				}
+			});
+	}
+	recorder.disable();
+	CHECK(recorder.dropped() == 0);
+
+	traffic_capture::mapped_file file{ path };
+	std::array<unsigned, threads> next{};
+	size_t entries{};
+	bool complete{ traffic_capture::for_each_entry(file.data(), [&](const traffic_capture::entry& e) {
+		++entries;
+		unsigned i{}, t{};
+		if (!check(std::sscanf(std::string{ e.target }.c_str(), "/item/%u?t=%u", &i, &t) == 2 && t < threads, "target of a recorded request"))
+			return;
+		check(i == next[t]++, std::format("request {} of thread {} out of order", i, t));
+		check(e.method == (i % 2 ? http::verb::get : http::verb::post), "method of a recorded request");
+		check(e.headers.size() == (i % 3 == 0 ? 2u : 1u), "only the selected headers are kept");
+		check(e.headers.front().first == http::field::host && e.headers.front().second == "127.0.0.1", "host header value");
+	}) };
+	CHECK(complete);
+	CHECK(entries == threads * requests_per_thread);
+}
+
+int main(int argc, char** argv)
+{
+	records_from_all_threads(argc > 1 ? argv[1] : "capture_test.urcap");
+	return check_result();
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "includes.h"
+#include <source_location>
+
+// Assertions for the test executables: a failed check is reported with its location and the
+// test's main returns check_result(), non-zero after any failure.
+inline int& check_failures()
+{
+	static int failures{};
+	return failures;
+}
+
+inline bool check(bool ok, std::string_view what, std::source_location where = std::source_location::current())
+{
+	if (!ok)
+	{
+		std::println(stderr, "{}:{}: check failed: {}", where.file_name(), where.line(), what);
+		++check_failures();
+	}
+	return ok;
+}
+
+#define CHECK(...) check(static_cast<bool>(__VA_ARGS__), #__VA_ARGS__)
+
+inline int check_result()
+{
+	if (check_failures())
+		std::println(stderr, "{} checks failed", check_failures());
+	return check_failures() ? 1 : 0;
+}
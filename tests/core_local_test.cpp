@@ -0,0 +1,93 @@
+#include "check.h"
+#include "defs.h"
+#include "core_local.h"
+
+using counter = core_local<std::atomic<uint64_t>>;
+
+// What a loop's instance knows about the threads that made and visited it.
+struct loop_state
+{
+	std::thread::id owner;
+	std::thread::id visited_on;
+};
+
+// Every thread counts in an instance of its own, which stays the same across calls and is still
+// aggregated after the thread has exited.
+static void threads_count_in_their_own_instances()
+{
+	constexpr unsigned threads{ 4 };
+	constexpr uint64_t hits{ 10000 };
+	std::array<std::atomic<uint64_t>*, threads> instances{};
+	std::array<bool, threads> stable{};
+	{
+		std::vector<std::jthread> workers;
+		for (unsigned t{}; t < threads; ++t)
+			workers.emplace_back([&, t] {
+				instances[t] = &counter::local();
+				stable[t] = true;
+				for (uint64_t i{}; i < hits; ++i)
+				{
+					auto& c{ counter::local() };
+					stable[t] = stable[t] && &c == instances[t];
+					c.fetch_add(1, std::memory_order_relaxed);
+				}
+			});
+	}
+
+	for (unsigned t{}; t < threads; ++t)
+	{
+		check(stable[t], std::format("thread {} keeps its instance", t));
+		for (unsigned u{}; u < t; ++u)
+			check(instances[t] != instances[u], std::format("threads {} and {} have instances of their own", u, t));
+	}
+	auto total{ counter::aggregate(uint64_t{}, [](uint64_t sum, std::atomic<uint64_t>& c) { return sum + c.load(std::memory_order_relaxed); }) };
+	CHECK(total == threads * hits);
+}
+
+// broadcast runs on the thread of each loop that owns an instance, and right away for the
+// calling thread's instance, which has no loop.
+static void broadcast_runs_on_the_owning_threads()
+{
+	constexpr unsigned loops{ 3 };
+	std::array<asio::io_context, loops> contexts;
+	std::atomic<unsigned> registered{};
+	std::atomic<unsigned> visited{};
+	std::vector<std::jthread> threads;
+	for (auto& ctx : contexts)
+		threads.emplace_back([&] {
+			auto guard{ asio::make_work_guard(ctx) };
+			core_local<loop_state>::local(&ctx).owner = std::this_thread::get_id();
+			++registered;
+			ctx.run();
+		});
+	core_local<loop_state>::local().owner = std::this_thread::get_id();
+	while (registered < loops)
+		std::this_thread::yield();
+
+	core_local<loop_state>::broadcast([&](loop_state& state) {
+		state.visited_on = std::this_thread::get_id();
+		++visited;
+	});
+	CHECK(core_local<loop_state>::local().visited_on == std::this_thread::get_id());
+	auto give_up{ std::chrono::steady_clock::now() + 5s };
+	while (visited < loops + 1 && std::chrono::steady_clock::now() < give_up)
+		std::this_thread::yield();
+	CHECK(visited == loops + 1);
+
+	unsigned instances{};
+	core_local<loop_state>::for_each([&](loop_state& state) {
+		++instances;
+		check(state.visited_on == state.owner, "instance visited on its owner's thread");
+	});
+	CHECK(instances == loops + 1);
+
+	for (auto& ctx : contexts)
+		ctx.stop();
+}
+
+int main()
+{
+	threads_count_in_their_own_instances();
+	broadcast_runs_on_the_owning_threads();
+	return check_result();
+}
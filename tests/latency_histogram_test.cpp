@@ -0,0 +1,33 @@
+#include "check.h"
+#include "latency_histogram.h"
+
+int main()
+{
+	latency_histogram h;
+	CHECK(h.count() == 0 && h.value_at_percentile(99) == 0);
+
+	// Below 1024 ns every value has its own bucket.
+	for (uint64_t v{ 1 }; v <= 1000; ++v)
+		h.record(v);
+	CHECK(h.count() == 1000);
+	CHECK(h.min() == 1 && h.max() == 1000);
+	CHECK(h.value_at_percentile(50) == 500);
+	CHECK(h.value_at_percentile(99) == 990);
+	CHECK(h.value_at_percentile(100) == 1000);
+
+	// Larger values keep their relative error within 2^-9.
+	latency_histogram wide;
+	for (uint64_t v : { 10'000ull, 1'000'000ull, 123'456'789ull })
+	{
+		latency_histogram one;
+		one.record(v);
+		auto reported{ one.value_at_percentile(50) };
+		CHECK(reported >= v && reported - v <= v / 512);
+		wide.merge(one);
+	}
+	CHECK(wide.count() == 3 && wide.min() == 10'000 && wide.max() == 123'456'789);
+
+	h.merge(wide);
+	CHECK(h.count() == 1003 && h.max() == 123'456'789);
+	return check_result();
+}
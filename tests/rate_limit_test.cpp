@@ -0,0 +1,45 @@
+#include "check.h"
+#include "defs.h"
+#include "rate_limit.h"
+
+constexpr int64_t second{ 1'000'000'000 };
+
+// Distinct keys must get buckets of their own even when their hashes only differ in the low
+// bits, as those of neighbouring IPv4 clients do. A handful may still land on fully probed
+// slots and share; unmixed keys lost half the clients that way.
+static void neighbouring_clients_do_not_share_buckets()
+{
+	auto table{ std::make_unique<rate_limit_table>() };
+	using limiter = route_rate_limiter<0, rate_limit<1, 1, rate_limit_key::client_ip>>;
+
+	size_t first_rejected{}, second_allowed{};
+	for (uint32_t client{}; client < 1024; ++client)
+	{
+		auto hash{ limiter::hash_address(boost::asio::ip::address_v4{ 0x0a000000u + client }) };
+		if (!table->try_acquire(hash, second, second, second))
+			++first_rejected;
+		if (table->try_acquire(hash, second, second, second))
+			++second_allowed;
+	}
+	CHECK(first_rejected <= 8);
+	CHECK(second_allowed == 0);
+}
+
+static void bucket_refills_at_its_rate()
+{
+	token_bucket bucket;
+	constexpr int64_t interval{ 1000 }, burst{ 3 * interval };
+	for (int i{}; i < 3; ++i)
+		CHECK(bucket.try_acquire(second, interval, burst));
+	CHECK(!bucket.try_acquire(second, interval, burst));
+	CHECK(bucket.try_acquire(second + interval, interval, burst));
+	CHECK(!bucket.try_acquire(second + interval, interval, burst));
+	CHECK(bucket.idle(second + 3 * interval));
+}
+
+int main()
+{
+	neighbouring_clients_do_not_share_buckets();
+	bucket_refills_at_its_rate();
+	return check_result();
+}
@@ -0,0 +1,65 @@
+#include "check.h"
+#include "demo_endpoints.h"
+
+using api_router = router_t<&api_aa, &not_found>;
+
+// Paths of up to three segments built from the demo routes' own text, digits with and without a
+// tail, empty segments and escapes.
+static std::vector<std::string> sample_paths()
+{
+	const std::array<std::string_view, 15> vocabulary{ "", "div", "hello", "hello2", "fib", "hits", "total", "echo", "api", "aa", "7", "7abc", "-1",
+		"99999999999", "%61a" };
+	std::vector<std::string> paths{ "/" };
+	for (auto a : vocabulary)
+	{
+		paths.push_back(std::format("/{}", a));
+		for (auto b : vocabulary)
+		{
+			paths.push_back(std::format("/{}/{}", a, b));
+			for (auto c : vocabulary)
+				paths.push_back(std::format("/{}/{}/{}", a, b, c));
+		}
+	}
+	paths.push_back("/div/7/3?x=1");
+	paths.push_back("/helloworld");
+	return paths;
+}
+
+// The segment matcher is a faster way to the character matcher's results: both must pick the
+// same routes and bind the same arguments.
+template<typename router>
+static void matchers_agree(const std::vector<std::string>& paths)
+{
+	for (auto& path : paths)
+	{
+		auto outcomes{ router::match_outcomes(path) };
+		for (size_t i{}; i < outcomes.size(); ++i)
+			check(outcomes[i][0] == outcomes[i][1], std::format("route {} matches {} differently segment by segment", i, path));
+	}
+}
+
+// Routes match a prefix of the path, and an integer argument ending the route takes the digits
+// its segment starts with.
+static void routes_match_prefixes()
+{
+	constexpr size_t hello_route{ 0 }, divide_route{ 1 }, hits_total_route{ 3 }, hits_route{ 4 };
+	CHECK(demo_router::match_outcomes("/hello/x")[hello_route][0]);
+	CHECK(demo_router::match_outcomes("/helloworld")[hello_route][0]);
+	CHECK(demo_router::match_outcomes("/div/7/3abc")[divide_route][0]);
+	CHECK(demo_router::match_outcomes("/div/7/3/4")[divide_route][0]);
+	CHECK(!demo_router::match_outcomes("/div/7abc/3")[divide_route][0]);
+	CHECK(!demo_router::match_outcomes("/div/7")[divide_route][0]);
+	CHECK(demo_router::match_outcomes("/div/7/3abc")[divide_route][0] == demo_router::match_outcomes("/div/7/3")[divide_route][0]);
+	CHECK(!demo_router::match_outcomes("/hit")[hits_route][0]);
+	CHECK(demo_router::match_outcomes("/hits/total")[hits_total_route][0]);
+	CHECK(!demo_router::match_outcomes("/hits")[hits_total_route][0]);
+}
+
+int main()
+{
+	auto paths{ sample_paths() };
+	matchers_agree<demo_router>(paths);
+	matchers_agree<api_router>(paths);
+	routes_match_prefixes();
+	return check_result();
+}
@@ -0,0 +1,191 @@
+#include "check.h"
+#include "demo_endpoints.h"
+
+static std::thread::id handler_thread;
+
+inline get_endpoint<"/where", cpu_bound>
+where()
+{
+	handler_thread = std::this_thread::get_id();
+	co_return response{ http::status::ok, 11, "here\n" };
+}
+
+static unsigned slow_runs;
+
+// Coalesced, so concurrent requests for the same item share one run; item 0 fails.
+inline get_endpoint<"/slow/<id>", coalesce>
+slow(path_arg<"id", uint32_t> id)
+{
+	++slow_runs;
+	asio::steady_timer timer{ co_await asio::this_coro::executor, 50ms };
+	co_await timer.async_wait(use_awaitable);
+	if (!id)
+		throw std::runtime_error{ "no item 0" };
+	co_return response{ http::status::ok, 11, std::format("item {}\n", id.value) };
+}
+
+using division_router = router_t<&divide>;
+using pool_router = router_t<&fib, &where>;
+using flight_router = router_t<&slow>;
+
+// Runs `a` to completion on `ctx` from the calling thread.
+template<typename T>
+static T run(asio::io_context& ctx, asio::awaitable<T> a)
+{
+	std::optional<T> result;
+	co_spawn(ctx, std::move(a), [&](std::exception_ptr e, T value) {
+		if (e)
+			std::rethrow_exception(e);
+		result.emplace(std::move(value));
+	});
+	ctx.restart();
+	ctx.run();
+	return std::move(*result);
+}
+
+static request get(std::string_view target, unsigned version = 11)
+{
+	return request{ http::verb::get, target, version };
+}
+
+// Bad URLs, unparsable arguments and unmatched paths come back as route_error values, and route()
+// answers them in the request's HTTP version and keep-alive setting.
+static void routing_errors_are_values()
+{
+	asio::io_context ctx;
+	division_router router;
+	auto expect_error{ [&](std::string_view target, route_error error) {
+		auto req{ get(target) };
+		auto result{ run(ctx, router.route_expected(req)) };
+		check(!result && result.error() == error, std::format("{} fails with route_error {}", target, static_cast<int>(error)));
+	} };
+	expect_error("/div/%zz/3", route_error::bad_url);
+	expect_error("/div/7/3?x=abc", route_error::bad_parameter);
+	expect_error("/mul/7/3", route_error::no_route);
+
+	auto req{ get("/div/6/3") };
+	auto result{ run(ctx, router.route_expected(req)) };
+	CHECK(result && result->result() == http::status::ok);
+
+	auto old{ get("/mul/7/3", 10) };
+	old.keep_alive(true);
+	auto resp{ run(ctx, router.route(old)) };
+	CHECK(resp.result() == http::status::not_found);
+	CHECK(resp.version() == 10);
+	CHECK(resp.keep_alive());
+}
+
+// resolve() picks the endpoint route() would, and routing the resolved request runs it.
+static void resolved_requests_route_like_requests()
+{
+	asio::io_context ctx;
+	division_router router;
+	division_router::resolved_request resolved;
+
+	request post{ http::verb::post, "/div/6/3", 11 };
+	auto& refused{ router.resolve(post, resolved) };
+	CHECK(refused.status == route_resolution::status_t::method_not_allowed);
+	CHECK(refused.allowed & http::verb::get);
+	CHECK(!(refused.allowed & http::verb::post));
+
+	auto req{ get("/div/6/3") };
+	CHECK(router.resolve(req, resolved).status == route_resolution::status_t::ok);
+	auto resp{ run(ctx, router.route(resolved)) };
+	CHECK(resp.result() == http::status::ok);
+	CHECK(resp.body().view() == "x = 0\n 2, zbytek 0\n");
+
+	auto bad{ get("/div/%zz") };
+	CHECK(router.resolve(bad, resolved).status == route_resolution::status_t::bad_url);
+	CHECK(run(ctx, router.route(resolved)).result() == http::status::bad_request);
+}
+
+// Verbs past the 32nd are in the mask too.
+static void verb_masks_cover_every_verb()
+{
+	auto mask{ verb_mask{} | http::verb::unlink };
+	CHECK(mask & http::verb::unlink);
+	CHECK(!(mask & http::verb::get));
+	CHECK(!(verbs::get & http::verb::unlink));
+}
+
+// cpu_bound handlers run on the work pool, and the router resumes on the connection's loop.
+static void cpu_bound_runs_on_the_pool()
+{
+	asio::io_context ctx;
+	pool_router router;
+	auto req{ get("/fib/10") };
+	CHECK(run(ctx, router.route(req)).body().view() == "fib(10) = 55\n");
+
+	std::thread::id resumed_on;
+	req = get("/where");
+	co_spawn(ctx, [&]() -> asio::awaitable<void> {
+		co_await router.route(req);
+		resumed_on = std::this_thread::get_id();
+	}, detached);
+	ctx.restart();
+	ctx.run();
+	CHECK(handler_thread != std::thread::id{} && handler_thread != std::this_thread::get_id());
+	CHECK(resumed_on == std::this_thread::get_id());
+}
+
+// Concurrent GETs with the same key run the handler once and share its body. A follower that is
+// cancelled stops waiting on its own, and a failed run fails every request waiting on it.
+static void coalesced_requests_share_one_run()
+{
+	constexpr size_t waiters{ 8 };
+	constexpr size_t cancelled{ 3 };
+	asio::io_context ctx;
+	flight_router router;
+	std::array<request, waiters> reqs;
+	std::array<std::optional<response>, waiters> resps;
+	std::array<std::exception_ptr, waiters> errors;
+	asio::cancellation_signal cancel;
+
+	auto spawn_all{ [&](std::string_view target) {
+		for (size_t i{}; i < waiters; ++i)
+		{
+			reqs[i] = get(target);
+			resps[i].reset();
+			errors[i] = nullptr;
+			auto done{ [&, i](std::exception_ptr e, response r) {
+				errors[i] = e;
+				if (!e)
+					resps[i].emplace(std::move(r));
+			} };
+			if (i == cancelled)
+				co_spawn(ctx, router.route(reqs[i]), asio::bind_cancellation_slot(cancel.slot(), std::move(done)));
+			else
+				co_spawn(ctx, router.route(reqs[i]), std::move(done));
+		}
+	} };
+
+	spawn_all("/slow/5");
+	asio::steady_timer later{ ctx, 10ms };
+	later.async_wait([&](boost::system::error_code) { cancel.emit(asio::cancellation_type::terminal); });
+	ctx.run();
+	CHECK(slow_runs == 1);
+	CHECK(errors[cancelled] && !resps[cancelled]);
+	for (size_t i{}; i < waiters; ++i)
+		if (i != cancelled)
+		{
+			check(resps[i] && resps[i]->body().view() == "item 5\n", std::format("waiter {} gets the shared response", i));
+			check(resps[i] && resps[i]->body().data() == resps[0]->body().data(), std::format("waiter {} shares the body", i));
+		}
+
+	spawn_all("/slow/0");
+	ctx.restart();
+	ctx.run();
+	CHECK(slow_runs == 2);
+	for (size_t i{}; i < waiters; ++i)
+		check(errors[i] && !resps[i], std::format("waiter {} sees the failed run", i));
+}
+
+int main()
+{
+	routing_errors_are_values();
+	resolved_requests_route_like_requests();
+	verb_masks_cover_every_verb();
+	cpu_bound_runs_on_the_pool();
+	coalesced_requests_share_one_run();
+	return check_result();
+}
@@ -0,0 +1,103 @@
+#include "check.h"
+#include "defs.h"
+#include "url_router.h"
+#include "server.h"
+
+constexpr uint16_t port{ 34560 };
+
+static bool stall_finished;
+static bool stall_cancelled;
+
+// Answers long after the tests are over, unless it is cancelled.
+inline get_endpoint<"/stall">
+stall()
+{
+	asio::steady_timer timer{ co_await asio::this_coro::executor, 1h };
+	try {
+		co_await timer.async_wait(use_awaitable);
+	}
+	catch (boost::system::system_error&)
+	{
+		stall_cancelled = true;
+		throw;
+	}
+	stall_finished = true;
+	co_return response{ http::status::ok, 11, "done\n" };
+}
+
+inline get_endpoint<"/boom">
+boom()
+{
+	asio::steady_timer timer{ co_await asio::this_coro::executor, 10ms };
+	co_await timer.async_wait(use_awaitable);
+	throw std::runtime_error{ "boom" };
+}
+
+using test_server = http_server<router_t<&stall, &boom>>;
+
+// Runs the coroutine `client` returns against the server listening on `ctx`, for at most 5 seconds.
+template<typename client_type>
+static void run_client(asio::io_context& ctx, client_type client, std::string_view what)
+{
+	bool done{};
+	co_spawn(ctx, std::move(client), [&](std::exception_ptr e) {
+		done = !e;
+		ctx.stop();
+	});
+	asio::steady_timer limit{ ctx, 5s };
+	limit.async_wait([&](boost::system::error_code ec) {
+		if (!ec)
+			ctx.stop();
+	});
+	ctx.restart();
+	ctx.run();
+	check(done, std::format("{} in time", what));
+}
+
+static asio::awaitable<tcp::socket> send(std::string_view raw)
+{
+	tcp::socket socket{ co_await asio::this_coro::executor };
+	co_await socket.async_connect({ asio::ip::address_v4::loopback(), port }, use_awaitable);
+	co_await asio::async_write(socket, asio::buffer(raw), use_awaitable);
+	co_return socket;
+}
+
+// A client that closes its connection while the handler runs cancels the handler, and that is
+// counted; a handler that throws ends the connection at once instead of waiting for the client.
+static void peer_close_cancels_the_handler()
+{
+	asio::io_context ctx;
+	test_server server{ ctx, port, asio::ip::address_v4::loopback() };
+	server.listen_tcp();
+
+	run_client(ctx, [&]() -> asio::awaitable<void> {
+		auto socket{ co_await send("GET /stall HTTP/1.1\r\nHost: test\r\n\r\n") };
+		asio::steady_timer pause{ ctx, 50ms };
+		co_await pause.async_wait(use_awaitable);
+		socket.close();
+		while (!server.metrics().cancelled_requests)
+		{
+			pause.expires_after(5ms);
+			co_await pause.async_wait(use_awaitable);
+		}
+	}, "a dropped connection cancels its request");
+	CHECK(server.metrics().cancelled_requests == 1);
+	CHECK(stall_cancelled);
+	CHECK(!stall_finished);
+
+	boost::system::error_code read_error;
+	run_client(ctx, [&]() -> asio::awaitable<void> {
+		auto socket{ co_await send("GET /boom HTTP/1.1\r\nHost: test\r\n\r\n") };
+		beast::flat_buffer buffer;
+		http::response<http::string_body> resp;
+		std::tie(read_error, std::ignore) = co_await http::async_read(socket, buffer, resp, asio::as_tuple(use_awaitable));
+	}, "a throwing handler closes the connection");
+	CHECK(read_error == http::error::end_of_stream);
+	CHECK(server.metrics().cancelled_requests == 1);
+}
+
+int main()
+{
+	peer_close_cancels_the_handler();
+	return check_result();
+}
@@ -0,0 +1,62 @@
+#include "check.h"
+#include "defs.h"
+#include "timer_wheel.h"
+
+using wheel_clock = timer_wheel::clock;
+
+// Deadlines on every level fire in order, never before their timeout, and a cancelled one not at
+// all, also when the wheel jumps over the ticks in between.
+static void deadlines_fire_in_order()
+{
+	asio::io_context ctx;
+	auto& wheel{ asio::use_service<timer_wheel>(ctx) };
+
+	std::vector<std::pair<int, wheel_clock::duration>> fired;
+	std::vector<std::unique_ptr<timer_wheel::deadline>> deadlines;
+	auto start{ wheel_clock::now() };
+	auto add{ [&](int id, wheel_clock::duration timeout) {
+		deadlines.push_back(std::make_unique<timer_wheel::deadline>(wheel, [&, id] { fired.emplace_back(id, wheel_clock::now() - start); }));
+		deadlines.back()->arm(timeout);
+	} };
+
+	add(3, 300ms);
+	add(0, 3ms);
+	add(2, 130ms);
+	add(1, 70ms);
+	add(4, 5s);
+	deadlines.back()->cancel();
+	ctx.run();
+
+	CHECK(fired.size() == 4);
+	const std::array<wheel_clock::duration, 4> timeouts{ 3ms, 70ms, 130ms, 300ms };
+	for (size_t i{}; i < fired.size(); ++i)
+	{
+		CHECK(fired[i].first == static_cast<int>(i));
+		CHECK(fired[i].second >= timeouts[i]);
+	}
+	CHECK(!wheel.armed());
+}
+
+static void async_wait_completes_and_cancels()
+{
+	asio::io_context ctx;
+	auto& wheel{ asio::use_service<timer_wheel>(ctx) };
+
+	boost::system::error_code waited{ asio::error::would_block }, cancelled;
+	asio::cancellation_signal signal;
+	wheel.async_wait(10ms, [&](boost::system::error_code ec) { waited = ec; });
+	wheel.async_wait(10s, asio::bind_cancellation_slot(signal.slot(), [&](boost::system::error_code ec) { cancelled = ec; }));
+	asio::post(ctx, [&] { signal.emit(asio::cancellation_type::terminal); });
+	ctx.run();
+
+	CHECK(!waited);
+	CHECK(cancelled == asio::error::operation_aborted);
+	CHECK(!wheel.armed());
+}
+
+int main()
+{
+	deadlines_fire_in_order();
+	async_wait_completes_and_cancels();
+	return check_result();
+}
@@ -0,0 +1,167 @@
+#include "check.h"
+#include "demo_endpoints.h"
+
+constexpr uint16_t port{ 34561 };
+constexpr size_t queue_limit{ 16 * 1024 };
+constexpr size_t flood_message{ 1024 };
+
+static uint64_t flood_dropped;
+
+// Queues `count` messages without waiting for any of them to be written.
+inline websocket_endpoint<"/flood/<count>">
+flood(path_arg<"count", uint32_t> count, ws_channel* channel)
+{
+	for (uint32_t i{}; i < count; ++i)
+		channel->send(std::string(flood_message, 'x'));
+	flood_dropped = channel->dropped();
+	co_return websocket_closed();
+}
+
+using test_server = http_server<router_t<&echo, &flood>>;
+
+// Runs the coroutine `client` returns against the server listening on `ctx`, for at most 5 seconds.
+template<typename client_type>
+static void run_client(asio::io_context& ctx, client_type client, std::string_view what)
+{
+	bool done{};
+	co_spawn(ctx, std::move(client), [&](std::exception_ptr e) {
+		done = !e;
+		ctx.stop();
+	});
+	asio::steady_timer limit{ ctx, 5s };
+	limit.async_wait([&](boost::system::error_code ec) {
+		if (!ec)
+			ctx.stop();
+	});
+	ctx.restart();
+	ctx.run();
+	check(done, std::format("{} in time", what));
+}
+
+static asio::awaitable<tcp::socket> connect()
+{
+	tcp::socket socket{ co_await asio::this_coro::executor };
+	co_await socket.async_connect({ asio::ip::address_v4::loopback(), port }, use_awaitable);
+	co_return socket;
+}
+
+static asio::awaitable<beast::websocket::stream<tcp::socket>> handshake(std::string_view target)
+{
+	beast::websocket::stream<tcp::socket> ws{ co_await connect() };
+	co_await ws.async_handshake("127.0.0.1", target, use_awaitable);
+	ws.text(true);
+	co_return ws;
+}
+
+// A client frame: text, final, masked as clients must.
+static std::string masked_text_frame(std::string_view payload)
+{
+	constexpr std::array<char, 4> mask{ 0x12, 0x34, 0x56, 0x78 };
+	std::string frame{ '\x81', static_cast<char>(0x80 | payload.size()) };
+	frame.append(mask.data(), mask.size());
+	for (size_t i{}; i < payload.size(); ++i)
+		frame += static_cast<char>(payload[i] ^ mask[i % mask.size()]);
+	return frame;
+}
+
+// An upgraded /echo session sends every message back `times` times, including a frame the
+// client sent in the same write as its handshake, which the server has already buffered while
+// reading the request.
+static void echo_sessions()
+{
+	asio::io_context ctx;
+	test_server server{ ctx, port, asio::ip::address_v4::loopback() };
+	server.listen_tcp();
+
+	std::vector<std::string> echoed;
+	run_client(ctx, [&]() -> asio::awaitable<void> {
+		auto ws{ co_await handshake("/echo/2") };
+		co_await ws.async_write(asio::buffer("ahoj"sv), use_awaitable);
+		for (int i{}; i < 2; ++i)
+		{
+			beast::flat_buffer message;
+			co_await ws.async_read(message, use_awaitable);
+			echoed.push_back(beast::buffers_to_string(message.data()));
+		}
+		co_await ws.async_close(beast::websocket::close_code::normal, use_awaitable);
+	}, "echo round trip");
+	CHECK(echoed == std::vector<std::string>{ "ahoj", "ahoj" });
+
+	std::string received;
+	run_client(ctx, [&]() -> asio::awaitable<void> {
+		auto socket{ co_await connect() };
+		auto upgrade{ std::format("GET /echo/1 HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+			"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n{}", masked_text_frame("ahoj")) };
+		co_await asio::async_write(socket, asio::buffer(upgrade), use_awaitable);
+
+		// The 101 head, then the echo as an unmasked server frame.
+		auto head_size{ co_await asio::async_read_until(socket, asio::dynamic_buffer(received), "\r\n\r\n", use_awaitable) };
+		auto frame_size{ 2 + "ahoj"sv.size() };
+		if (received.size() < head_size + frame_size)
+			co_await asio::async_read(socket, asio::dynamic_buffer(received), asio::transfer_exactly(head_size + frame_size - received.size()), use_awaitable);
+		received.erase(0, head_size);
+	}, "frame sent behind the handshake");
+	CHECK(received == "\x81\x04" "ahoj");
+}
+
+// Plain requests for a websocket endpoint get 426, and the connection stays usable.
+static void plain_requests_are_refused()
+{
+	asio::io_context ctx;
+	test_server server{ ctx, port, asio::ip::address_v4::loopback() };
+	server.listen_tcp();
+
+	std::vector<unsigned> statuses;
+	run_client(ctx, [&]() -> asio::awaitable<void> {
+		auto socket{ co_await connect() };
+		co_await asio::async_write(socket, asio::buffer("GET /echo/1 HTTP/1.1\r\nHost: test\r\n\r\nGET /echo/1 HTTP/1.1\r\nHost: test\r\n\r\n"sv), use_awaitable);
+		beast::flat_buffer buffer;
+		for (int i{}; i < 2; ++i)
+		{
+			http::response<http::string_body> resp;
+			co_await http::async_read(socket, buffer, resp, use_awaitable);
+			statuses.push_back(resp.result_int());
+		}
+	}, "plain requests answered");
+	CHECK(statuses == std::vector<unsigned>{ 426, 426 });
+}
+
+// Messages over the server's queue limit are dropped and counted; the ones queued before it are
+// delivered before the session closes.
+static void full_queues_drop_messages()
+{
+	constexpr uint32_t sent{ 64 };
+	constexpr size_t queued{ queue_limit / flood_message };
+	asio::io_context ctx;
+	test_server server{ ctx, port, asio::ip::address_v4::loopback() };
+	server.m_websocket_queue_limit = queue_limit;
+	server.listen_tcp();
+
+	size_t received{};
+	boost::system::error_code end;
+	run_client(ctx, [&]() -> asio::awaitable<void> {
+		auto ws{ co_await handshake(std::format("/flood/{}", sent)) };
+		for (;;)
+		{
+			beast::flat_buffer message;
+			auto [ec, bytes] { co_await ws.async_read(message, asio::as_tuple(use_awaitable)) };
+			if (ec)
+			{
+				end = ec;
+				break;
+			}
+			++received;
+		}
+	}, "flood session");
+	CHECK(received == queued);
+	CHECK(flood_dropped == sent - queued);
+	CHECK(end == beast::websocket::error::closed);
+}
+
+int main()
+{
+	echo_sessions();
+	plain_requests_are_refused();
+	full_queues_drop_messages();
+	return check_result();
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "includes.h"
+
+// Per-thread buffers emptied by one background thread, behind the tracer, the access log and the
+// traffic capture. Producers only touch the buffer of their own thread; the drain thread runs the
+// owner's flush every interval, which visits every registered buffer. Buffers are found through a
+// thread_local, so there is one set per buffer_type and each owner has a buffer type of its own.
+template<typename buffer_type>
+class thread_drainer
+{
+	std::atomic<bool> m_enabled{};
+	std::atomic<uint64_t> m_dropped{};
+	std::mutex m_mutex;
+	std::vector<std::shared_ptr<buffer_type>> m_buffers;
+	std::jthread m_thread;
+
+public:
+	bool enabled() const noexcept
+	{
+		return m_enabled.load(std::memory_order_relaxed);
+	}
+
+	// Records producers gave up on because their buffer was full.
+	uint64_t dropped() const noexcept
+	{
+		return m_dropped.load(std::memory_order_relaxed);
+	}
+
+	void count_drop() noexcept
+	{
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Buffer of the calling thread, registered on its first use.
+	buffer_type& local()
+	{
+		thread_local std::shared_ptr<buffer_type> buffer{ [this] {
+			auto b{ std::make_shared<buffer_type>() };
+			std::scoped_lock lock{ m_mutex };
+			m_buffers.push_back(b);
+			return b;
+		}() };
+		return *buffer;
+	}
+
+	// Calls `f` with every buffer registered so far; the registry is not locked meanwhile.
+	template<typename F>
+	void for_each_buffer(F&& f)
+	{
+		std::vector<std::shared_ptr<buffer_type>> buffers;
+		{
+			std::scoped_lock lock{ m_mutex };
+			buffers = m_buffers;
+		}
+		for (auto& buffer : buffers)
+			f(*buffer);
+	}
+
+	// Starts the drain thread, which calls `flush` every `interval`, and reports enabled.
+	void start(std::chrono::milliseconds interval, std::function<void()> flush)
+	{
+		stop();
+		m_thread = std::jthread{ [interval, flush = std::move(flush)](std::stop_token stop) {
+			std::mutex mutex;
+			std::condition_variable_any wakeup;
+			while (!stop.stop_requested())
+			{
+				std::unique_lock lock{ mutex };
+				wakeup.wait_for(lock, stop, interval, [] { return false; });
+				flush();
+			}
+		} };
+		m_enabled.store(true, std::memory_order_release);
+	}
+
+	// Reports disabled and joins the drain thread; the owner then flushes what is left itself.
+	void stop()
+	{
+		m_enabled.store(false, std::memory_order_release);
+		if (m_thread.joinable())
+		{
+			m_thread.request_stop();
+			m_thread.join();
+		}
+	}
+};
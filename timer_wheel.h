@@ -0,0 +1,284 @@
+#pragma once
+#include "includes.h"
+
+struct timer_wheel_entry
+{
+	timer_wheel_entry* next{};
+	timer_wheel_entry** pprev{};
+	uint64_t expiry{};
+	void (*fire)(timer_wheel_entry&){};
+	void (*destroy)(timer_wheel_entry&){};
+};
+
+// Hierarchical timer wheel, one per io_context (asio::use_service<timer_wheel>(ctx)). Entries
+// live in intrusive lists, so arming, re-arming and cancelling are O(1), and re-arming a deadline
+// allocates nothing. A single steady_timer sleeps until the next occupied slot, on whichever level
+// it is. The wheel is not synchronized: it must only be used from the one thread running its
+// io_context, which debug builds assert. Servers spreading connections over several threads give
+// each thread an io_context, and with it a wheel, of its own.
+class timer_wheel : public boost::asio::execution_context::service
+{
+public:
+	using clock = std::chrono::steady_clock;
+	static constexpr clock::duration resolution{ std::chrono::milliseconds{ 1 } };
+	static inline boost::asio::execution_context::id id;
+
+private:
+	static constexpr unsigned slot_bits{ 6 };
+	static constexpr uint64_t slot_count{ 1ull << slot_bits };
+	static constexpr uint64_t slot_mask{ slot_count - 1 };
+	static constexpr unsigned level_count{ 4 };
+	static constexpr uint64_t max_delta{ (1ull << (slot_bits * level_count)) - 1 };
+
+	std::array<std::array<timer_wheel_entry*, slot_count>, level_count> m_slots{};
+	clock::time_point m_origin{ clock::now() };
+	uint64_t m_tick{};
+	uint64_t m_wake_tick{ ~0ull };
+	uint64_t m_generation{};
+	size_t m_armed{};
+	boost::asio::steady_timer m_timer;
+	std::thread::id m_owner;
+
+	// The first thread to arm an entry owns the wheel.
+	void check_owner()
+	{
+		if (m_owner == std::thread::id{})
+			m_owner = std::this_thread::get_id();
+		BOOST_ASSERT_MSG(m_owner == std::this_thread::get_id(), "timer_wheel used from more than one thread");
+	}
+
+	uint64_t current_tick() const
+	{
+		return static_cast<uint64_t>((clock::now() - m_origin) / resolution);
+	}
+
+	static void link(timer_wheel_entry*& head, timer_wheel_entry& e)
+	{
+		e.next = head;
+		if (head)
+			head->pprev = &e.next;
+		head = &e;
+		e.pprev = &head;
+	}
+
+	static void unlink(timer_wheel_entry& e)
+	{
+		*e.pprev = e.next;
+		if (e.next)
+			e.next->pprev = e.pprev;
+		e.next = nullptr;
+		e.pprev = nullptr;
+	}
+
+	void place(timer_wheel_entry& e)
+	{
+		e.expiry = std::max(e.expiry, m_tick);
+		auto delta{ e.expiry - m_tick };
+		unsigned level{};
+		while (level + 1 < level_count && delta >> (slot_bits * (level + 1)))
+			++level;
+		auto at{ std::min(e.expiry, m_tick + max_delta) };
+		link(m_slots[level][(at >> (slot_bits * level)) & slot_mask], e);
+	}
+
+	template<typename F>
+	static void drain(timer_wheel_entry*& slot, F&& f)
+	{
+		auto pending{ slot };
+		slot = nullptr;
+		if (pending)
+			pending->pprev = &pending;
+		while (pending)
+		{
+			auto& e{ *pending };
+			unlink(e);
+			f(e);
+		}
+	}
+
+	// Moves the wheel to `target`, jumping straight between the ticks that have entries to
+	// cascade or fire.
+	void advance(uint64_t target)
+	{
+		while (m_tick < target)
+		{
+			auto next{ m_armed ? next_wake() : target };
+			if (next > target)
+			{
+				m_tick = target;
+				break;
+			}
+			m_tick = next;
+			for (unsigned level{ 1 }; level < level_count && !(m_tick & ((1ull << (slot_bits * level)) - 1)); ++level)
+				drain(m_slots[level][(m_tick >> (slot_bits * level)) & slot_mask], [this](timer_wheel_entry& e) { place(e); });
+			drain(m_slots[0][m_tick & slot_mask], [this](timer_wheel_entry& e) {
+				--m_armed;
+				e.fire(e);
+			});
+		}
+	}
+
+	// Next tick worth waking up for: the first tick after m_tick at which an occupied slot is
+	// drained, either firing its entries (innermost level) or cascading them (outer levels). A
+	// slot on level L is drained whenever the tick is a multiple of 64^L with the slot's index.
+	uint64_t next_wake() const
+	{
+		uint64_t next{ ~0ull };
+		for (unsigned level{}; level < level_count; ++level)
+		{
+			auto shift{ slot_bits * level };
+			for (uint64_t k{ 1 }; k <= slot_count; ++k)
+			{
+				auto position{ (m_tick >> shift) + k };
+				if (m_slots[level][position & slot_mask])
+				{
+					next = std::min(next, position << shift);
+					break;
+				}
+			}
+		}
+		return next;
+	}
+
+	void schedule(uint64_t tick)
+	{
+		if (tick >= m_wake_tick)
+			return;
+		m_wake_tick = tick;
+		m_timer.expires_at(m_origin + tick * resolution);
+		m_timer.async_wait([this, generation{ ++m_generation }](boost::system::error_code ec) {
+			if (ec == boost::asio::error::operation_aborted || generation != m_generation)
+				return;
+			m_wake_tick = ~0ull;
+			advance(current_tick());
+			if (m_armed)
+				schedule(next_wake());
+		});
+	}
+
+	void shutdown() override
+	{
+		std::vector<timer_wheel_entry*> entries;
+		for (auto& level : m_slots)
+			for (auto& slot : level)
+				drain(slot, [&](timer_wheel_entry& e) { entries.push_back(&e); });
+		m_armed = 0;
+		m_timer.cancel();
+		for (auto e : entries)
+			if (e->destroy)
+				e->destroy(*e);
+	}
+
+	struct wait_op : timer_wheel_entry
+	{
+		boost::asio::cancellation_slot slot;
+		boost::asio::any_completion_handler<void(boost::system::error_code)> handler;
+
+		template<typename handler_t>
+		explicit wait_op(handler_t&& h)
+			: slot{ boost::asio::get_associated_cancellation_slot(h) }, handler{ std::forward<handler_t>(h) }
+		{
+			fire = [](timer_wheel_entry& e) { complete(static_cast<wait_op*>(&e), {}); };
+			destroy = [](timer_wheel_entry& e) { delete static_cast<wait_op*>(&e); };
+		}
+
+		static void complete(wait_op* op, boost::system::error_code ec)
+		{
+			op->slot.clear();
+			auto h{ std::move(op->handler) };
+			delete op;
+			auto ex{ boost::asio::get_associated_executor(h) };
+			boost::asio::post(ex, [h = std::move(h), ec]() mutable { std::move(h)(ec); });
+		}
+	};
+
+public:
+	explicit timer_wheel(boost::asio::io_context& ctx)
+		: boost::asio::execution_context::service{ ctx }, m_timer{ ctx }
+	{}
+
+	size_t armed() const
+	{
+		return m_armed;
+	}
+
+	void arm(timer_wheel_entry& e, clock::duration timeout)
+	{
+		check_owner();
+		if (e.pprev)
+			unlink(e);
+		else if (!m_armed++)
+			m_tick = std::max(m_tick, current_tick());
+
+		auto ticks{ static_cast<uint64_t>((std::max(timeout, clock::duration::zero()) + resolution - clock::duration{ 1 }) / resolution) };
+		e.expiry = current_tick() + std::max<uint64_t>(ticks, 1);
+		place(e);
+		schedule(e.expiry);
+	}
+
+	void cancel(timer_wheel_entry& e)
+	{
+		if (!e.pprev)
+			return;
+		check_owner();
+		unlink(e);
+		--m_armed;
+	}
+
+	// Completes with operation_aborted when cancelled through the handler's cancellation slot.
+	template<typename CompletionToken>
+	auto async_wait(clock::duration timeout, CompletionToken&& token)
+	{
+		return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code)>(
+			[this, timeout](auto handler) {
+				auto op{ new wait_op{ std::move(handler) } };
+				if (op->slot.is_connected())
+					op->slot.assign([this, op](boost::asio::cancellation_type) {
+						if (!op->pprev)
+							return;
+						cancel(*op);
+						boost::asio::post(m_timer.get_executor(), [op] { wait_op::complete(op, boost::asio::error::operation_aborted); });
+					});
+				arm(*op, timeout);
+			}, token);
+	}
+
+	// RAII wheel entry that invokes a callback on expiry; meant to be re-armed for every phase of
+	// a connection (idle, request) instead of creating a new timer each time.
+	class deadline : timer_wheel_entry
+	{
+		timer_wheel& m_wheel;
+		std::move_only_function<void()> m_on_expiry;
+
+	public:
+		template<typename F>
+		deadline(timer_wheel& wheel, F&& on_expiry)
+			: m_wheel{ wheel }, m_on_expiry{ std::forward<F>(on_expiry) }
+		{
+			fire = [](timer_wheel_entry& e) { static_cast<deadline&>(e).m_on_expiry(); };
+		}
+
+		deadline(const deadline&) = delete;
+		deadline& operator =(const deadline&) = delete;
+
+		~deadline()
+		{
+			cancel();
+		}
+
+		void arm(clock::duration timeout)
+		{
+			m_wheel.arm(*this, timeout);
+		}
+
+		void cancel()
+		{
+			m_wheel.cancel(*this);
+		}
+
+		bool armed() const
+		{
+			return pprev != nullptr;
+		}
+	};
+};
@@ -0,0 +1,122 @@
+#include "includes.h"
+#include "defs.h"
+#include "timer_wheel.h"
+#include "latency_histogram.h"
+
+// Connection deadline workload: every connection holds one deadline that is re-armed twice per
+// keep-alive request (request timeout after the read, idle timeout after the write), compared
+// against one asio::steady_timer per connection doing the same.
+
+constexpr size_t connection_count{ 100'000 };
+constexpr size_t rounds{ 20 };
+
+using bench_clock = std::chrono::steady_clock;
+
+static void report(std::string_view name, size_t operations, bench_clock::duration elapsed)
+{
+	std::chrono::duration<double, std::nano> ns{ elapsed };
+	std::println("{:<40} {:>10} ops {:>10.1f} ms {:>8.1f} ns/op", name, operations, ns.count() / 1e6, ns.count() / operations);
+}
+
+static void bench_wheel_rearm()
+{
+	asio::io_context ctx{ 1 };
+	auto& wheel{ asio::use_service<timer_wheel>(ctx) };
+	std::vector<std::unique_ptr<timer_wheel::deadline>> deadlines;
+	deadlines.reserve(connection_count);
+	for (size_t i{}; i < connection_count; ++i)
+		deadlines.push_back(std::make_unique<timer_wheel::deadline>(wheel, [] {}));
+
+	auto start{ bench_clock::now() };
+	for (auto& d : deadlines)
+		d->arm(60s);
+	report("timer_wheel: arm idle deadline", connection_count, bench_clock::now() - start);
+
+	start = bench_clock::now();
+	for (size_t r{}; r < rounds; ++r)
+		for (auto& d : deadlines)
+		{
+			d->arm(30s);
+			d->arm(60s);
+		}
+	report("timer_wheel: re-arm request/idle", connection_count * rounds * 2, bench_clock::now() - start);
+
+	start = bench_clock::now();
+	deadlines.clear();
+	report("timer_wheel: cancel on close", connection_count, bench_clock::now() - start);
+}
+
+static void bench_steady_timer_rearm()
+{
+	asio::io_context ctx{ 1 };
+	std::vector<std::unique_ptr<asio::steady_timer>> timers;
+	timers.reserve(connection_count);
+	for (size_t i{}; i < connection_count; ++i)
+		timers.push_back(std::make_unique<asio::steady_timer>(ctx));
+
+	auto arm{ [](asio::steady_timer& t, bench_clock::duration timeout) {
+		t.expires_after(timeout);
+		t.async_wait([](boost::system::error_code) {});
+	} };
+
+	auto start{ bench_clock::now() };
+	for (auto& t : timers)
+		arm(*t, 60s);
+	report("steady_timer: arm idle deadline", connection_count, bench_clock::now() - start);
+
+	start = bench_clock::now();
+	for (size_t r{}; r < rounds; ++r)
+	{
+		for (auto& t : timers)
+		{
+			arm(*t, 30s);
+			arm(*t, 60s);
+		}
+		ctx.poll();
+		ctx.restart();
+	}
+	report("steady_timer: re-arm request/idle", connection_count * rounds * 2, bench_clock::now() - start);
+
+	start = bench_clock::now();
+	timers.clear();
+	ctx.poll();
+	report("steady_timer: cancel on close", connection_count, bench_clock::now() - start);
+}
+
+// Arms deadlines spread over one second and measures how late each one fires.
+static void bench_wheel_expiry()
+{
+	asio::io_context ctx{ 1 };
+	auto& wheel{ asio::use_service<timer_wheel>(ctx) };
+	latency_histogram lateness;
+	std::vector<bench_clock::time_point> due(connection_count);
+	std::vector<std::unique_ptr<timer_wheel::deadline>> deadlines;
+	deadlines.reserve(connection_count);
+
+	std::mt19937 rng{ 1 };
+	std::uniform_int_distribution<int> spread{ 1, 1000 };
+	for (size_t i{}; i < connection_count; ++i)
+	{
+		deadlines.push_back(std::make_unique<timer_wheel::deadline>(wheel, [&, i] {
+			lateness.record(bench_clock::now() - due[i]);
+		}));
+		std::chrono::milliseconds timeout{ spread(rng) };
+		due[i] = bench_clock::now() + timeout;
+		deadlines.back()->arm(timeout);
+	}
+
+	auto start{ bench_clock::now() };
+	ctx.run();
+	report("timer_wheel: expire 100k over 1s", connection_count, bench_clock::now() - start);
+	std::println("{:<40} p50 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms", "timer_wheel: lateness",
+		lateness.value_at_percentile(50) / 1e6, lateness.value_at_percentile(99) / 1e6, lateness.max() / 1e6);
+}
+
+int main()
+{
+	std::println("{} connections, {} keep-alive requests each", connection_count, rounds);
+	bench_wheel_rearm();
+	bench_steady_timer_rearm();
+	bench_wheel_expiry();
+	return 0;
+}
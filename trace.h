@@ -0,0 +1,261 @@
+#pragma once
+#include "includes.h"
+#include "spsc_ring.h"
+#include "thread_drainer.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define URL_ROUTER_HAS_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define URL_ROUTER_HAS_TSC 1
+#endif
+
+// Per-request phase tracing. Spans are stamped with the TSC (steady_clock where there is none),
+// pushed into a ring owned by the recording thread and written out by a background flusher as a
+// Chrome/Perfetto JSON trace. Unsampled requests only pay for a null check.
+namespace tracing
+{
+	inline uint64_t timestamp() noexcept
+	{
+#ifdef URL_ROUTER_HAS_TSC
+		return __rdtsc();
+#else
+		return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+	}
+
+	struct event
+	{
+		std::string_view name;
+		std::string_view detail;
+		uint64_t begin;
+		uint64_t end;
+		uint64_t request_id;
+	};
+
+	// Passed to the router as an explicit argument; endpoints taking a request_trace* receive it
+	// too and can forward it to subrouters.
+	struct request_trace
+	{
+		uint64_t id{};
+		bool sampled{};
+		unsigned depth{};
+	};
+
+	class tracer
+	{
+		static constexpr size_t ring_capacity{ 1 << 14 };
+
+		struct thread_buffer
+		{
+			spsc_ring<event, ring_capacity> events;
+			uint32_t tid{ next_tid.fetch_add(1, std::memory_order_relaxed) };
+			uint64_t next_request{};
+			uint32_t sample_counter{};
+
+			static inline std::atomic<uint32_t> next_tid{ 1 };
+		};
+
+		thread_drainer<thread_buffer> m_drainer;
+		std::atomic<uint32_t> m_sample_every{ 1 };
+		std::FILE* m_file{};
+		bool m_first_event{ true };
+		uint64_t m_tick_origin{};
+		double m_ns_per_tick{ 1.0 };
+
+		tracer() = default;
+
+		void calibrate()
+		{
+#ifdef URL_ROUTER_HAS_TSC
+			auto clock_begin{ std::chrono::steady_clock::now() };
+			auto tick_begin{ timestamp() };
+			std::this_thread::sleep_for(20ms);
+			auto tick_end{ timestamp() };
+			std::chrono::duration<double, std::nano> elapsed{ std::chrono::steady_clock::now() - clock_begin };
+			m_ns_per_tick = elapsed.count() / static_cast<double>(tick_end - tick_begin);
+			m_tick_origin = tick_begin;
+#else
+			m_ns_per_tick = std::chrono::duration<double, std::nano>{ std::chrono::steady_clock::duration{ 1 } }.count();
+			m_tick_origin = timestamp();
+#endif
+		}
+
+		static void append_escaped(std::string& out, std::string_view s)
+		{
+			for (auto c : s)
+				if (c == '"' || c == '\\')
+					(out += '\\') += c;
+				else if (static_cast<unsigned char>(c) >= 0x20)
+					out += c;
+		}
+
+		void flush()
+		{
+			std::string out;
+			m_drainer.for_each_buffer([&](thread_buffer& buffer) {
+				buffer.events.consume_all([&](const event& e) {
+					auto us{ [&](uint64_t ticks) { return static_cast<double>(ticks) * m_ns_per_tick / 1000.0; } };
+					out += m_first_event ? "\n" : ",\n";
+					m_first_event = false;
+					out += R"({"name":")";
+					append_escaped(out, e.name);
+					std::format_to(std::back_inserter(out), R"(","cat":"http","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f},"args":{{"request":{})",
+						buffer.tid, us(e.begin - m_tick_origin), us(e.end - e.begin), e.request_id);
+					if (!e.detail.empty())
+					{
+						out += R"(,"detail":")";
+						append_escaped(out, e.detail);
+						out += '"';
+					}
+					out += "}}";
+				});
+			});
+
+			if (!out.empty())
+			{
+				std::fwrite(out.data(), 1, out.size(), m_file);
+				std::fflush(m_file);
+			}
+		}
+
+	public:
+		static tracer& instance()
+		{
+			static tracer t;
+			return t;
+		}
+
+		tracer(const tracer&) = delete;
+		tracer& operator =(const tracer&) = delete;
+
+		~tracer()
+		{
+			disable();
+		}
+
+		bool enabled() const noexcept
+		{
+			return m_drainer.enabled();
+		}
+
+		uint64_t dropped() const noexcept
+		{
+			return m_drainer.dropped();
+		}
+
+		// Starts writing a trace to `path`, tracing every `sample_every`-th request of each thread.
+		void enable(const std::string& path, uint32_t sample_every = 1, std::chrono::milliseconds flush_interval = 100ms)
+		{
+			disable();
+
+			m_file = std::fopen(path.c_str(), "wb");
+			if (!m_file)
+				throw std::runtime_error{ std::format("cannot open trace file {}", path) };
+			std::fputs(R"({"displayTimeUnit":"ns","traceEvents":[)", m_file);
+			m_first_event = true;
+			calibrate();
+
+			m_sample_every.store(std::max(sample_every, 1u), std::memory_order_relaxed);
+			m_drainer.start(flush_interval, [this] { flush(); });
+		}
+
+		void disable()
+		{
+			m_drainer.stop();
+			if (m_file)
+			{
+				flush();
+				std::fputs("\n]}\n", m_file);
+				std::fclose(m_file);
+				m_file = nullptr;
+			}
+		}
+
+		request_trace begin_request()
+		{
+			if (!enabled())
+				return {};
+			auto& buffer{ m_drainer.local() };
+			if (buffer.sample_counter++ % m_sample_every.load(std::memory_order_relaxed))
+				return {};
+			return { (static_cast<uint64_t>(buffer.tid) << 40) | ++buffer.next_request, true };
+		}
+
+		void record(const event& e)
+		{
+			if (!m_drainer.local().events.try_push(e))
+				m_drainer.count_drop();
+		}
+	};
+
+	inline void record(request_trace* trace, std::string_view name, std::string_view detail, uint64_t begin)
+	{
+		if (trace && trace->sampled)
+			tracer::instance().record({ name, detail, begin, timestamp(), trace->id });
+	}
+
+	// Records the enclosing scope as one complete event. Names and details must have static
+	// storage duration, the flusher formats them long after the span is gone.
+	class span
+	{
+		request_trace* m_trace;
+		std::string_view m_name;
+		std::string_view m_detail;
+		uint64_t m_begin{};
+
+	public:
+		span(request_trace* trace, std::string_view name, std::string_view detail = {}) noexcept
+			: m_trace{ trace && trace->sampled ? trace : nullptr }, m_name{ name }, m_detail{ detail }
+		{
+			if (m_trace)
+				m_begin = timestamp();
+		}
+
+		span(const span&) = delete;
+		span& operator =(const span&) = delete;
+
+		~span()
+		{
+			record(m_trace, m_name, m_detail, m_begin);
+		}
+	};
+
+	// Span around one router::route call; nested calls for the same request are reported as
+	// subrouter dispatch.
+	class route_scope
+	{
+		request_trace* m_trace;
+		span m_span;
+
+	public:
+		explicit route_scope(request_trace* trace) noexcept
+			: m_trace{ trace }, m_span{ trace, trace && trace->depth ? "subrouter" : "route" }
+		{
+			if (m_trace)
+				++m_trace->depth;
+		}
+
+		route_scope(const route_scope&) = delete;
+		route_scope& operator =(const route_scope&) = delete;
+
+		~route_scope()
+		{
+			if (m_trace)
+				--m_trace->depth;
+		}
+	};
+
+	// URL_ROUTER_TRACE=<file> enables tracing, URL_ROUTER_TRACE_SAMPLE=<n> traces every n-th request.
+	inline void enable_from_environment()
+	{
+		auto path{ std::getenv("URL_ROUTER_TRACE") };
+		if (!path || !*path)
+			return;
+		uint32_t sample_every{ 1 };
+		if (auto sample{ std::getenv("URL_ROUTER_TRACE_SAMPLE") })
+			std::from_chars(sample, sample + std::strlen(sample), sample_every);
+		tracer::instance().enable(path, sample_every);
+	}
+}
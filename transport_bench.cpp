@@ -0,0 +1,99 @@
+#include "includes.h"
+#include "defs.h"
+#include "url_router.h"
+#include "server.h"
+#include "load_client.h"
+
+// Same server, same keep-alive client, once over loopback TCP and once over a Unix domain
+// socket, so the difference is the transport cost per request.
+
+get_endpoint<"/plaintext">
+plaintext()
+{
+	co_return response{ http::status::ok, 11, "Hello, World!" };
+}
+
+get_endpoint<"/item/<id>">
+item(path_arg<"id", uint32_t> id)
+{
+	co_return response{ http::status::ok, 11, std::format("item {}\n", id.value) };
+}
+
+using bench_server = http_server<router_t<&plaintext, &item>>;
+
+constexpr uint16_t tcp_port{ 34541 };
+constexpr unsigned connection_count{ 16 };
+constexpr unsigned pipeline_depth{ 1 };
+
+template<typename socket_type, typename endpoint_type>
+static bool run_transport(std::string_view name, const load_plan& plan, const endpoint_type& endpoint, std::chrono::seconds duration, uint64_t min_requests)
+{
+	asio::io_context ctx{ 1 };
+	load_stats stats{ plan.targets.size() };
+	auto until{ std::chrono::steady_clock::now() + duration };
+	for (unsigned i{}; i < connection_count; ++i)
+	{
+		socket_type socket{ ctx };
+		socket.connect(endpoint);
+		if constexpr (std::is_same_v<socket_type, tcp::socket>)
+			socket.set_option(tcp::no_delay{ true });
+		co_spawn(ctx, run_load_connection(std::move(socket), plan, stats, i * 7919, until), detached);
+	}
+
+	auto start{ std::chrono::steady_clock::now() };
+	ctx.run();
+	std::chrono::duration<double> elapsed{ std::chrono::steady_clock::now() - start };
+
+	std::println("{}:", name);
+	print_load_report(plan, stats, elapsed);
+	return !stats.errors && stats.completed_at_least(min_requests);
+}
+
+// usage: transport_bench [SECONDS [MIN_REQUESTS]], 5 seconds per transport by default. The run
+// fails when a transport completes fewer than MIN_REQUESTS requests.
+int main(int argc, char** argv)
+{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+	std::chrono::seconds duration{ 5 };
+	if (argc > 1)
+		duration = std::chrono::seconds{ std::strtoul(argv[1], nullptr, 10) };
+	uint64_t min_requests{};
+	if (argc > 2)
+		min_requests = std::strtoull(argv[2], nullptr, 10);
+
+	load_plan plan;
+	plan.pipeline_depth = pipeline_depth;
+	plan.add_target("/plaintext", 1);
+	plan.add_target("/item/42", 1);
+	plan.build_schedule();
+
+	auto socket_path{ std::format("/tmp/url_router_bench.{}.sock", ::getpid()) };
+
+	asio::io_context server_ctx{ 1 };
+	bench_server server{ server_ctx, tcp_port, asio::ip::address_v4::loopback() };
+	server.listen_tcp();
+	server.listen_unix(socket_path);
+	std::jthread server_thread{ [&] { server_ctx.run(); } };
+
+	std::println("{} connections, pipeline depth {}, {}s per transport", connection_count, pipeline_depth, duration.count());
+	int result{};
+	try {
+		if (!run_transport<tcp::socket>("loopback tcp", plan, tcp::endpoint{ asio::ip::address_v4::loopback(), tcp_port }, duration, min_requests))
+			result = 3;
+		if (!run_transport<asio::local::stream_protocol::socket>("unix domain socket", plan, asio::local::stream_protocol::endpoint{ socket_path }, duration, min_requests))
+			result = 3;
+	}
+	catch (std::exception& ex)
+	{
+		std::println(stderr, "transport bench failed: {}", ex.what());
+		result = 1;
+	}
+
+	server_ctx.stop();
+	std::remove(socket_path.c_str());
+	return result;
+#else
+	std::println(stderr, "unix domain sockets are not available on this platform");
+	return 1;
+#endif
+}
@@ -1,4 +1,15 @@
 #pragma once
+#include "trace.h"
+#include "rate_limit.h"
+#include "coalescing.h"
+#include "work_pool.h"
+#include "body_limit.h"
+#include "path_segments.h"
+#include "core_local.h"
+#include "access_log.h"
+#include "websocket.h"
+#include "shared_body.h"
+#include "canned_response.h"
 
 struct verb_mask
 {
@@ -10,7 +21,7 @@ struct verb_mask
 
 	constexpr verb_mask operator |(boost::beast::http::verb verb) const
 	{
-		return { value | (1 << static_cast<int>(verb))};
+		return { value | (1ull << static_cast<unsigned>(verb)) };
 	}
 
 	constexpr verb_mask operator |(const verb_mask &b) const
@@ -20,7 +31,7 @@ struct verb_mask
 
 	constexpr bool operator &(boost::beast::http::verb verb) const
 	{
-		return { static_cast<bool>(value & (1 << static_cast<int>(verb))) };
+		return { static_cast<bool>(value & (1ull << static_cast<unsigned>(verb))) };
 	}
 };
 
@@ -114,8 +125,6 @@ consteval special find_special(literal<N> l, size_t from)
 	return { special::type_t::nothing };
 }
 
-struct last {};
-
 template<literal l, typename T = void>
 struct argument_pattern {};
 
@@ -125,45 +134,157 @@ struct fixed_pattern
 	static constexpr literal lit{ l };
 };
 
-template<typename pattern, typename next>
-struct pattern_chain {};
-
-template<literal l, size_t from>
-consteval auto find_patterns()
-{
-	if constexpr (constexpr auto b{ find_special(l, from) }; b.type != special::type_t::nothing)
-	{
-		if constexpr (b.type == special::type_t::asterisk)
-			return pattern_chain<
-			fixed_pattern<l.substr<from, b.position - from>()>,
-			pattern_chain<
-			fixed_pattern<"*">,
-			decltype(find_patterns<l, b.position + b.length>())>>{};
-		else if constexpr (b.type == special::type_t::double_asterisk)
-			return pattern_chain<
-			fixed_pattern<l.substr<from, b.position - from>()>,
-			pattern_chain<
-			fixed_pattern<"**">,
-			decltype(find_patterns<l, b.position + b.length>())>>{};
-		else if constexpr(b.type == special::type_t::argument_pattern)
-			return pattern_chain<
-			fixed_pattern<l.substr<from, b.position - from>()>,
-			pattern_chain<
-			argument_pattern<l.substr<b.position + 1, b.length - 1>()>,
-			decltype(find_patterns<l, b.position + b.length + 1>())>>{};
-	}
-	else if constexpr (from == l.str.size())
-		return last{};
+// One element of a route string: a fixed run of characters, `*`, `**` or an `<argument>` name.
+struct route_token
+{
+	special::type_t type;
+	std::size_t position;
+	std::size_t length;
+};
+
+template<size_t N, typename F>
+consteval void for_each_route_token(literal<N> l, F&& f)
+{
+	size_t from{};
+	for (;;)
+	{
+		auto b{ find_special(l, from) };
+		if (b.type == special::type_t::nothing)
+		{
+			if (from != l.size)
+				f(route_token{ special::type_t::nothing, from, l.size - from });
+			return;
+		}
+		if (b.position != from)
+			f(route_token{ special::type_t::nothing, from, b.position - from });
+		if (b.type == special::type_t::argument_pattern)
+		{
+			f(route_token{ b.type, b.position + 1, b.length - 1 });
+			from = b.position + b.length + 1;
+		}
+		else
+		{
+			f(route_token{ b.type, b.position, b.length });
+			from = b.position + b.length;
+		}
+	}
+}
+
+template<literal l>
+consteval size_t route_token_count()
+{
+	size_t count{};
+	for_each_route_token(l, [&](route_token) { ++count; });
+	return count;
+}
+
+template<literal l>
+consteval auto route_tokens()
+{
+	std::array<route_token, route_token_count<l>()> tokens{};
+	size_t i{};
+	for_each_route_token(l, [&](route_token t) { tokens[i++] = t; });
+	return tokens;
+}
+
+template<literal l, route_token t>
+consteval auto make_pattern()
+{
+	if constexpr (t.type == special::type_t::asterisk)
+		return fixed_pattern<"*">{};
+	else if constexpr (t.type == special::type_t::double_asterisk)
+		return fixed_pattern<"**">{};
+	else if constexpr (t.type == special::type_t::argument_pattern)
+		return argument_pattern<l.template substr<t.position, t.length>()>{};
 	else
-		return pattern_chain<
-		fixed_pattern<l.substr<from, l.str.size() - from>()>,
-		last>{};
+		return fixed_pattern<l.template substr<t.position, t.length>()>{};
 }
 
+template<literal l, size_t...i>
+consteval auto make_pattern_tuple(std::index_sequence<i...>)
+{
+	constexpr auto tokens{ route_tokens<l>() };
+	return std::tuple<decltype(make_pattern<l, tokens[i]>())...>{};
+}
+
+// Route string to a flat std::tuple of patterns. The string is tokenized once in a consteval
+// loop and the tuple is expanded from an index_sequence, so neither the instantiation depth
+// nor the number of instantiations grows with recursion over the tokens.
 template<literal l>
 consteval auto parse_route_string()
 {
-	return find_patterns<l, 0>();
+	return make_pattern_tuple<l>(std::make_index_sequence<route_token_count<l>()>());
+}
+
+// Splits a route string at '/' into one token per segment: fixed text, `<argument>` or a trailing
+// `*` (the rest of the path). `**` is fixed text, as it is to the character matcher. Returns false
+// when a segment mixes text with an argument or wildcard, or `*` is not last; such routes are
+// matched character by character instead.
+template<size_t N, typename F>
+consteval bool for_each_route_segment(literal<N> l, F&& f)
+{
+	if (!l.size || l.str[0] != '/')
+		return false;
+
+	for (size_t from{ 1 };;)
+	{
+		size_t to{ from };
+		while (to < l.size && l.str[to] != '/')
+			++to;
+		std::string_view segment{ l.str.data() + from, to - from };
+		bool last{ to == l.size };
+
+		if (segment == "*")
+		{
+			if (!last)
+				return false;
+			f(route_token{ special::type_t::asterisk, from, segment.size() });
+		}
+		else if (segment == "**")
+			f(route_token{ special::type_t::nothing, from, segment.size() });
+		else if (segment.size() > 2 && segment.front() == '<' && segment.back() == '>' && segment.find_first_of("<>*", 1) == segment.size() - 1)
+			f(route_token{ special::type_t::argument_pattern, from + 1, segment.size() - 2 });
+		else if (segment.find_first_of("<>*") == std::string_view::npos)
+			f(route_token{ special::type_t::nothing, from, segment.size() });
+		else
+			return false;
+
+		if (last)
+			return true;
+		from = to + 1;
+	}
+}
+
+template<literal l>
+consteval size_t route_segment_count()
+{
+	size_t count{};
+	return for_each_route_segment(l, [&](route_token) { ++count; }) ? count : 0;
+}
+
+template<literal l>
+consteval auto route_segments()
+{
+	std::array<route_token, route_segment_count<l>()> tokens{};
+	size_t i{};
+	for_each_route_segment(l, [&](route_token t) { tokens[i++] = t; });
+	return tokens;
+}
+
+template<literal l, size_t...i>
+consteval auto make_segment_tuple(std::index_sequence<i...>)
+{
+	constexpr auto tokens{ route_segments<l>() };
+	return std::tuple<decltype(make_pattern<l, tokens[i]>())...>{};
+}
+
+// Route string to one pattern per path segment, where a trailing fixed_pattern<"*"> stands for
+// the rest of the path; void for routes that are not segment aligned.
+template<literal l>
+consteval auto parse_route_segments()
+{
+	if constexpr (route_segment_count<l>() != 0)
+		return make_segment_tuple<l>(std::make_index_sequence<route_segment_count<l>()>());
 }
 
 template<literal l, typename T>
@@ -210,6 +331,86 @@ struct query_arg
 	}
 };
 
+template<typename T>
+void append_coalescing_arg(std::string& key, const T& arg) {}
+
+template<literal l, typename T>
+void append_coalescing_arg(std::string& key, const path_arg<l, T>& arg)
+{
+	append_coalescing_value(key, arg.value);
+}
+
+template<literal l, typename T>
+void append_coalescing_arg(std::string& key, const query_arg<l, T>& arg)
+{
+	append_coalescing_value(key, arg.value);
+}
+
+// Handler arguments that stay valid after the request is gone, which a coalesced handler run needs
+// as it may outlive the request that started it: argument values the handler owns, and pointers
+// to what lives as long as the server's event loop.
+template<typename T>
+struct outlives_request : std::false_type {};
+
+template<literal l, typename T>
+struct outlives_request<path_arg<l, T>> : std::bool_constant<!std::is_same_v<T, std::string_view>> {};
+
+template<literal l, typename T>
+struct outlives_request<query_arg<l, T>> : std::true_type {};
+
+template<typename T>
+struct outlives_request<core_local<T>> : std::true_type {};
+
+template<>
+struct outlives_request<timer_wheel*> : std::true_type {};
+
+template<>
+struct outlives_request<boost::asio::io_context*> : std::true_type {};
+
+template<typename...args>
+std::string coalescing_key(const std::tuple<args...>& values)
+{
+	std::string key;
+	std::apply([&](const auto&...arg) { (append_coalescing_arg(key, arg), ...); }, values);
+	return key;
+}
+
+enum class route_error { bad_url, bad_parameter, no_route };
+
+inline const canned_response& canned_error(route_error error)
+{
+	static const std::array<canned_response, 3> responses{
+		canned_response{ boost::beast::http::status::bad_request, "bad url\n" },
+		canned_response{ boost::beast::http::status::bad_request, "bad parameter\n" },
+		canned_response{ boost::beast::http::status::not_found, "not found\n" }
+	};
+	return responses[static_cast<size_t>(error)];
+}
+
+inline response error_response(route_error error, unsigned version, bool keep_alive)
+{
+	return canned_error(error)(version, keep_alive);
+}
+
+// Outcome of routing a request head before its body is read.
+struct route_resolution
+{
+	enum class status_t { ok, bad_url, not_found, method_not_allowed };
+
+	status_t status{ status_t::not_found };
+	// Methods of every endpoint whose path matched, for the Allow header of a 405.
+	verb_mask allowed{};
+	// body_limit policy of the accepting endpoint.
+	std::optional<uint64_t> body_limit;
+	// The accepting endpoint is a websocket_endpoint, which takes upgrade requests' connections over.
+	bool websocket{};
+};
+
+struct peer_info
+{
+	boost::asio::ip::address address;
+};
+
 struct url_arg
 {
 	boost::urls::url_view url;
@@ -230,33 +431,37 @@ struct url_arg
 	}
 };
 
-template<typename chain>
-struct dechain {};
+struct ignore_t {};
+
+template<literal L, typename T>
+struct is_path_arg_named : std::false_type {};
 
-template<>
-struct dechain<last>
+template<literal L, typename T>
+struct is_path_arg_named<L, path_arg<L, T>> : std::true_type {};
+
+// Position of path_arg<L, ...> among args, sizeof...(args) when there is none.
+template<literal L, typename...args>
+consteval size_t path_arg_position()
 {
-	using tuple = std::tuple<>;
-};
+	constexpr std::array<bool, sizeof...(args) + 1> named{ is_path_arg_named<L, args>::value..., true };
+	return static_cast<size_t>(std::ranges::find(named, true) - named.begin());
+}
 
-template<typename pattern>
-struct dechain<pattern_chain<pattern, last>>
+template<size_t position, typename argument_tuple>
+struct path_arg_at
 {
-	using tuple = std::tuple<pattern>;
+	using type = ignore_t;
+	using arg = void;
 };
 
-template<typename pattern, typename next>
-struct dechain<pattern_chain<pattern, next>>
+template<size_t position, typename...args>
+	requires (position < sizeof...(args))
+struct path_arg_at<position, std::tuple<args...>>
 {
-	using tuple = decltype(
-		std::tuple_cat(
-			std::declval<typename std::tuple<pattern>>(),
-			std::declval<typename dechain<next>::tuple>()
-		));
+	using arg = std::tuple_element_t<position, std::tuple<args...>>;
+	using type = decltype(arg::value);
 };
 
-struct ignore_t {};
-
 template<std::size_t index_, typename pattern, typename argument_tuple>
 struct arg_finder 
 {
@@ -265,14 +470,6 @@ struct arg_finder
 	using arg = void;
 };
 
-template<std::size_t index_, literal L, typename T, typename...Args>
-struct arg_finder<index_, argument_pattern<L>, std::tuple<path_arg<L, T>, Args...>>
-{
-	static constexpr auto index{ index_ };
-	using type = T;
-	using arg = path_arg<L, T>;
-};
-
 template<std::size_t index_, literal L>
 struct arg_finder<index_, argument_pattern<L>, void>
 {
@@ -281,44 +478,64 @@ struct arg_finder<index_, argument_pattern<L>, void>
 	using arg = void;
 };
 
-template<std::size_t index_, literal L, literal L2, typename T, typename...Args>
-struct arg_finder<index_, argument_pattern<L>, std::tuple<path_arg<L2, T>, Args...>>
+template<std::size_t index_, literal L, typename...args>
+struct arg_finder<index_, argument_pattern<L>, std::tuple<args...>>
 {
-	static constexpr auto index{ index_ };
-	using next_arg_finder = arg_finder<index + 1, argument_pattern<L>, std::tuple<Args...>>;
-	using type = next_arg_finder::type;
-	using arg = next_arg_finder::arg;
+	static constexpr auto position{ path_arg_position<L, args...>() };
+	static constexpr auto index{ index_ + position };
+	using type = path_arg_at<position, std::tuple<args...>>::type;
+	using arg = path_arg_at<position, std::tuple<args...>>::arg;
+};
+
+template<typename tag, typename policy_tuple>
+struct find_policy
+{
+	using type = void;
 };
 
-template<verb_mask verb_mask_, literal route_string, typename result_t>
+template<typename tag, typename first, typename...rest>
+struct find_policy<tag, std::tuple<first, rest...>>
+{
+	using type = std::conditional_t<std::is_base_of_v<tag, first>, first, typename find_policy<tag, std::tuple<rest...>>::type>;
+};
+
+template<verb_mask verb_mask_, literal route_string, typename result_t, typename...policies_>
 struct basic_endpoint
 {
 	using route = decltype(parse_route_string<route_string>());
+	using segments = decltype(parse_route_segments<route_string>());
 
 	using return_type_t = result_t;
+	using policies = std::tuple<policies_...>;
 	static constexpr verb_mask mask{ verb_mask_ };
+	static constexpr std::string_view route_name{ route_string };
 
 	result_t value;
 	basic_endpoint(return_type_t&& value) : value{ std::forward<return_type_t>(value) } {};
 };
 
-template<verb_mask verbs, literal route_string>
-using endpoint = boost::asio::awaitable<basic_endpoint<verbs, route_string, boost::beast::http::response<boost::beast::http::string_body>>>;
+template<verb_mask verbs, literal route_string, typename...policies>
+using endpoint = boost::asio::awaitable<basic_endpoint<verbs, route_string, boost::beast::http::response<shared_text_body>, policies...>>;
 
-template<literal route_string>
-using get_endpoint = endpoint<verbs::get, route_string>;
+template<literal route_string, typename...policies>
+using get_endpoint = endpoint<verbs::get, route_string, policies...>;
 
-template<literal route_string>
-using post_endpoint = endpoint<verbs::post, route_string>;
+template<literal route_string, typename...policies>
+using post_endpoint = endpoint<verbs::post, route_string, policies...>;
 
-template<literal route_string>
-using put_endpoint = endpoint<verbs::put, route_string>;
+template<literal route_string, typename...policies>
+using put_endpoint = endpoint<verbs::put, route_string, policies...>;
 
-template<literal route_string>
-using delete_endpoint = endpoint<verbs::delete_, route_string>;
+template<literal route_string, typename...policies>
+using delete_endpoint = endpoint<verbs::delete_, route_string, policies...>;
 
-template<literal route_string>
-using any_endpoint = endpoint<verbs::any, route_string>;
+template<literal route_string, typename...policies>
+using any_endpoint = endpoint<verbs::any, route_string, policies...>;
+
+// GET endpoint that upgrades the connection to a WebSocket; the handler takes a ws_channel* and
+// ends with co_return websocket_closed(). Plain GETs to it are answered 426.
+template<literal route_string, typename...policies>
+using websocket_endpoint = endpoint<verbs::get, route_string, upgrades_to_websocket, policies...>;
 
 template<typename T>
 struct route_extractor {};
@@ -328,9 +545,13 @@ struct route_extractor<endpoint(*)(args_...)>
 {
 	static constexpr bool is_awaitable{ false };
 	static constexpr auto mask{ endpoint::mask };
+	static constexpr auto route_name{ endpoint::route_name };
 	using route = endpoint::route;
+	using segments = endpoint::segments;
+	using policies = endpoint::policies;
 	using args = std::tuple<args_...>;
 	using return_type = endpoint::return_type_t;
+	using response_type = endpoint::return_type_t;
 };
 
 template<typename endpoint, typename...args_>
@@ -338,9 +559,13 @@ struct route_extractor<boost::asio::awaitable<endpoint>(*)(args_...)>
 {
 	static constexpr bool is_awaitable{ true };
 	static constexpr auto mask{ endpoint::mask };
+	static constexpr auto route_name{ endpoint::route_name };
 	using route = endpoint::route;
+	using segments = endpoint::segments;
+	using policies = endpoint::policies;
 	using args = std::tuple<args_...>;
 	using return_type = boost::asio::awaitable<typename endpoint::return_type_t>;
+	using response_type = endpoint::return_type_t;
 };
 
 template<typename klass, typename endpoint, typename...args_>
@@ -348,9 +573,13 @@ struct route_extractor<endpoint(klass::*)(args_...)>
 {
 	static constexpr bool is_awaitable{ false };
 	static constexpr auto mask{ endpoint::mask };
+	static constexpr auto route_name{ endpoint::route_name };
 	using route = endpoint::route;
+	using segments = endpoint::segments;
+	using policies = endpoint::policies;
 	using args = std::tuple<klass *, args_...>;
 	using return_type = endpoint::return_type_t;
+	using response_type = endpoint::return_type_t;
 };
 
 template<typename klass, typename endpoint, typename...args_>
@@ -358,9 +587,13 @@ struct route_extractor<boost::asio::awaitable<endpoint>(klass::*)(args_...)>
 {
 	static constexpr bool is_awaitable{ true };
 	static constexpr auto mask{ endpoint::mask };
+	static constexpr auto route_name{ endpoint::route_name };
 	using route = endpoint::route;
+	using segments = endpoint::segments;
+	using policies = endpoint::policies;
 	using args = std::tuple<klass *, args_...>;
 	using return_type = boost::asio::awaitable<endpoint>;
+	using response_type = endpoint::return_type_t;
 };	
 
 template<typename T>
@@ -430,7 +663,7 @@ private:
 				if (auto [match, str] { ctre::match<R"(^([^/]+).*)">(begin, end) }; match)
 				{
 					begin += str.size();
-					std::get<arg>(values) = str;
+					std::get<arg>(values).value = str.to_view();
 					return true;
 				}
 				else
@@ -452,41 +685,158 @@ private:
 		}
 	};
 
-	bool match(std::string_view url)
+	// The segment matchers reproduce the character matcher's results. A segment followed by
+	// another one must be taken whole, since the character matcher then has to find the '/'
+	// right after it; the route's last segment, like the character matcher, only has to match a
+	// prefix of what is left of the path.
+	template<typename argument_tuple, typename T, typename tuple, bool last>
+	struct single_segment_matcher {};
+
+	template<typename argument_tuple, literal L, typename tuple, bool last>
+	struct single_segment_matcher<argument_tuple, fixed_pattern<L>, tuple, last>
 	{
-		return true;
-	}
+		bool operator()(tuple& values, const path_segments& path, size_t i) const
+		{
+			if constexpr (last)
+				return path[i].starts_with(static_cast<std::string_view>(L));
+			else
+			{
+				constexpr auto fingerprint{ path_segments::fingerprint(L) };
+				return path.fingerprint(i) == fingerprint && path[i] == static_cast<std::string_view>(L);
+			}
+		}
+	};
 
-	template<typename route, typename tuple>
-	bool matches(std::string_view url, tuple& values)
+	template<typename argument_tuple, typename tuple>
+	struct single_segment_matcher<argument_tuple, fixed_pattern<"*">, tuple, true>
 	{
-		using pattern_tuple = dechain<typename route::route>::tuple;
-		using matcher = pattern_matcher<tuple, typename route::args, pattern_tuple>;
-		if (matcher{}(values, url))
+		bool operator()(tuple& values, const path_segments& path, size_t i) const
+		{
 			return true;
-		else
-			return false;
+		}
+	};
+
+	template<typename argument_tuple, literal L, typename tuple, bool last>
+	struct single_segment_matcher<argument_tuple, argument_pattern<L>, tuple, last>
+	{
+		bool operator()(tuple& values, const path_segments& path, size_t i) const
+		{
+			using argument_finder = arg_finder<0, argument_pattern<L>, argument_tuple>;
+			using type = argument_finder::type;
+			using arg = argument_finder::arg;
+
+			auto segment{ path[i] };
+			if constexpr (std::is_same_v<type, ignore_t>)
+			{
+				// Arguments the handler does not take consume nothing.
+				return last || segment.empty();
+			}
+			else if constexpr (std::is_integral_v<type>)
+			{
+				// As many digits as there are; only the last segment may go on after them.
+				if (segment.empty() || segment.front() < '0' || segment.front() > '9')
+					return false;
+				auto result{ std::from_chars(segment.data(), segment.data() + segment.size(), std::get<arg>(values).value) };
+				return result.ec == std::errc{} && (last || result.ptr == segment.data() + segment.size());
+			}
+			else if constexpr (std::is_same_v<type, std::string_view>)
+			{
+				std::get<arg>(values).value = segment;
+				return !segment.empty();
+			}
+		}
+	};
+
+	template<typename tuple, typename argument_tuple, typename T>
+	struct segment_matcher {};
+
+	template<typename tuple, typename argument_tuple, typename...patterns>
+	struct segment_matcher<tuple, argument_tuple, std::tuple<patterns...>>
+	{
+		bool operator()(tuple& values, const path_segments& path) const
+		{
+			if (path.size() < sizeof...(patterns))
+				return false;
+			return [&]<size_t...i>(std::index_sequence<i...>) {
+				return (single_segment_matcher<argument_tuple, patterns, tuple, i + 1 == sizeof...(patterns)>{}(values, path, i) && ...);
+			}(std::index_sequence_for<patterns...>{});
+		}
+	};
+
+	// Views the request target: the path is matched in encoded form unless it holds escapes, in
+	// which case it is decoded once into `decoded_path`.
+	static std::string_view routed_path(boost::urls::url_view url, std::string& decoded_path)
+	{
+		std::string_view encoded{ url.encoded_path() };
+		if (encoded.find('%') == std::string_view::npos)
+			return encoded;
+		decoded_path = url.path();
+		return decoded_path;
 	}
 
 	struct route_context
 	{
-		boost::urls::url url;
-		request req;
-		boost::urls::params_ref params{ url.params() };
+		boost::urls::url_view url;
+		request& req;
+		boost::urls::params_view params{ url.params() };
+		std::string decoded_path;
+		std::string_view path{ routed_path(url, decoded_path) };
+		path_segments segments{ path };
+		tracing::request_trace* trace{};
+		boost::asio::io_context* loop{};
+		access_logging::matched_route* match{};
+		websocket_upgrade* upgrade{};
+		uint64_t match_begin{};
+		const peer_info* peer{};
+		// Span try_route records: "bind" once resolve() has matched the request, as routing it then
+		// only binds the arguments of the one endpoint left.
+		std::string_view match_span{ "match" };
 	};
 
+	// Routes match a prefix of the path: fixed text and arguments in order, whatever follows them
+	// is ignored.
+	template<typename route, typename tuple>
+	static bool matches_characters(const route_context& ctx, tuple& values)
+	{
+		using pattern_tuple = typename route::route;
+		using matcher = pattern_matcher<tuple, typename route::args, pattern_tuple>;
+		return matcher{}(values, ctx.path);
+	}
+
+	// Segment aligned routes match the path segment by segment, with the character matcher's
+	// results; other routes, and paths too long to segment, use the character matcher.
+	template<typename route, typename tuple>
+	static bool matches(const route_context& ctx, tuple& values)
+	{
+		if constexpr (!std::is_void_v<typename route::segments>)
+			if (ctx.segments.segmented())
+				return segment_matcher<tuple, typename route::args, typename route::segments>{}(values, ctx.segments);
+		return matches_characters<route>(ctx, values);
+	}
+
+	template<typename T, typename...args>
+	static T find_explicit_arg(const args&...expl_args)
+	{
+		T result{};
+		(([&] { if constexpr (std::is_same_v<args, T>) result = expl_args; }()), ...);
+		return result;
+	}
+
 	template<typename T>
 	struct non_path_arg_filler 
 	{
 		template<typename tuple>
-		static void fill(tuple& values, const route_context& ctx) {}
+		static bool fill(tuple& values, const route_context& ctx)
+		{
+			return true;
+		}
 	};
 
 	template<literal L, typename T>
 	struct non_path_arg_filler<query_arg<L, T>>
 	{
 		template<typename tuple>
-		static void fill(tuple& values, const route_context& ctx)
+		static bool fill(tuple& values, const route_context& ctx)
 		{
 			if (auto i{ ctx.params.find(static_cast<std::string_view>(L)) }; i != ctx.params.end())
 			{
@@ -496,17 +846,17 @@ private:
 					if (auto [match, str] { ctre::match<R"(^(\d+).*)">(val.begin(), val.end()) }; match)
 					{
 						auto result{ std::from_chars(str.data(), str.data() + str.size(), std::get<query_arg<L, T>>(values).value) };
-						if (result.ec != std::errc{})
-							throw std::runtime_error{ "bad parm" };
+						return result.ec == std::errc{};
 					}
 					else
-						throw std::runtime_error{ "bad parm" };
+						return false;
 				}
 				else if constexpr (std::is_same_v<T, std::string_view>)
-					static_assert(bool_const<false, T>, "query_arg must NOT be a string_view. Use string.");
+					static_assert(bool_const<false, T>::value, "query_arg must NOT be a string_view. Use string.");
 				else if constexpr (std::is_same_v<T, std::string>)
-					std::get<query_arg<L, T>>(values) = std::move(val);
+					std::get<query_arg<L, T>>(values).value = std::move(val);
 			}
+			return true;
 		}
 	};
 
@@ -514,22 +864,34 @@ private:
 	struct non_path_arg_filler<url_arg>
 	{
 		template<typename tuple>
-		static void fill(tuple& values, const route_context& ctx)
+		static bool fill(tuple& values, const route_context& ctx)
 		{
 			std::get<url_arg>(values).url = boost::urls::url_view{ ctx.url };
+			return true;
+		}
+	};
+
+	template<typename T>
+	struct non_path_arg_filler<core_local<T>>
+	{
+		template<typename tuple>
+		static bool fill(tuple& values, const route_context& ctx)
+		{
+			std::get<core_local<T>>(values).value = &core_local<T>::local(ctx.loop);
+			return true;
 		}
 	};
 
 	template<typename arg, typename tuple>
-	void fill_non_path_arg(tuple& values, const route_context& ctx)
+	bool fill_non_path_arg(tuple& values, const route_context& ctx)
 	{
-		non_path_arg_filler<arg>::fill(values, ctx);
+		return non_path_arg_filler<arg>::fill(values, ctx);
 	}
 
 	template<typename... args>
-	void fill_non_path_args(std::tuple<args...>& values, const route_context& ctx)
+	bool fill_non_path_args(std::tuple<args...>& values, const route_context& ctx)
 	{
-		((fill_non_path_arg<args>(values, ctx)), ...);
+		return (fill_non_path_arg<args>(values, ctx) && ...);
 	}
 
 	template<typename first, typename... rest>
@@ -541,18 +903,23 @@ private:
 	using return_type = typename route_extractor<typename first_type_getter<decltype(routes)...>::type>::return_type;
 	static constexpr bool is_async{ route_extractor<typename first_type_getter<decltype(routes)...>::type>::is_awaitable };
 
+	using response_type = typename route_extractor<typename first_type_getter<decltype(routes)...>::type>::response_type;
+	using result_type = std::expected<response_type, route_error>;
+	using expected_return_type = std::conditional_t<is_async, boost::asio::awaitable<result_type>, result_type>;
+
+	static response_type to_response(result_type&& result, unsigned version, bool keep_alive)
+	{
+		if (result)
+			return std::move(*result);
+		return error_response(result.error(), version, keep_alive);
+	}
+
 	template <typename T, typename Tuple>
 	struct has_type;
 
 	template <typename T, typename... Us>
 	struct has_type<T, std::tuple<Us...>> : std::disjunction<std::is_same<T, Us>...> {};
 
-	template<typename explicit_args_tuple>
-	return_type try_route(explicit_args_tuple expl_args, const route_context& ctx)
-	{
-		throw std::runtime_error{ "no route" };
-	}
-
 	template<typename value_tuple, typename tuple>
 	struct explicit_args_filler {};
 
@@ -565,37 +932,214 @@ private:
 		}
 	};
 
-	template<typename explicit_args_tuple, auto route, auto...other_routes>
-	return_type try_route(explicit_args_tuple expl_args, const route_context& ctx)
+	template<auto route>
+	static return_type call_owned(typename route_extractor<decltype(route)>::args values)
+	{
+		co_return (co_await std::apply(route, std::move(values))).value;
+	}
+
+	template<auto route>
+	return_type invoke(typename route_extractor<decltype(route)>::args values, const route_context& ctx)
+	{
+		using re = route_extractor<decltype(route)>;
+		tracing::span handler{ ctx.trace, "handler", re::route_name };
+
+		// The handler runs inside the session, and the connection's response becomes the marker
+		// telling the server the connection is no longer HTTP.
+		using session = find_policy<websocket_policy, typename re::policies>::type;
+		if constexpr (re::is_awaitable && !std::is_void_v<session>)
+		{
+			static_assert(std::is_void_v<typename find_policy<coalesce_policy, typename re::policies>::type>
+				&& std::is_void_v<typename find_policy<cpu_bound_policy, typename re::policies>::type>,
+				"websocket endpoints cannot be coalesced or cpu_bound");
+			co_await ctx.upgrade->run(ctx.req, [&](ws_channel& channel) -> boost::asio::awaitable<void> {
+				if constexpr (has_type<ws_channel*, typename re::args>::value)
+					std::get<ws_channel*>(values) = &channel;
+				co_await std::apply(route, std::move(values));
+			});
+			co_return websocket_closed();
+		}
+
+		// The handler run is detached from the request that started it, so it takes its
+		// arguments with it.
+		using coalescing = find_policy<coalesce_policy, typename re::policies>::type;
+		if constexpr (re::is_awaitable && !std::is_void_v<coalescing>)
+		{
+			static_assert([]<typename...args>(std::tuple<args...>*) { return (outlives_request<args>::value && ...); }(static_cast<typename re::args*>(nullptr)),
+				"coalesced handlers can only take path and query arguments (no string_view path_arg), core_local, timer_wheel* and io_context*");
+			if (ctx.req.method() == boost::beast::http::verb::get)
+			{
+				auto key{ coalescing_key(values) };
+				co_return *co_await route_single_flight<route>::flights.run(std::move(key), co_await boost::asio::this_coro::executor,
+					[values = std::move(values)]() mutable { return call_owned<route>(std::move(values)); });
+			}
+		}
+
+		// The co_spawn completion brings the coroutine back to the connection's executor.
+		using offload = find_policy<cpu_bound_policy, typename re::policies>::type;
+		if constexpr (re::is_awaitable && !std::is_void_v<offload>)
+			co_return co_await boost::asio::co_spawn(work_pool::instance().get_executor(),
+				[&]() -> return_type { co_return (co_await std::apply(route, std::move(values))).value; }, use_awaitable);
+
+		if constexpr (re::is_awaitable)
+			co_return (co_await std::apply(route, std::move(values))).value;
+		else
+			return std::apply(route, std::move(values)).value;
+	}
+
+	static return_type ready(response resp)
+	{
+		if constexpr (is_async)
+			co_return resp;
+		else
+			return resp;
+	}
+
+	// Matches one route synchronously. Returns true once routing is decided: `result` then holds
+	// the (not yet started) handler, or stays empty and `error` says why.
+	template<auto route, typename explicit_args_tuple>
+	bool try_route(const explicit_args_tuple& expl_args, const route_context& ctx, std::optional<return_type>& result, route_error& error)
 	{
 		using re = route_extractor<decltype(route)>;
 		using tuple = re::args;
 		tuple values{};
 		explicit_args_filler<tuple, explicit_args_tuple>::fill(values, expl_args);
-		if (re::mask & ctx.req.method() && matches<re>(ctx.url.path(), values))
+		if (!(re::mask & ctx.req.method()) || !matches<re>(ctx, values))
+			return false;
+		if (ctx.match)
+			ctx.match->route = re::route_name;
+
+		if constexpr (!std::is_void_v<typename find_policy<websocket_policy, typename re::policies>::type>)
+			if (!ctx.upgrade)
+			{
+				result.emplace(ready(upgrade_required_response(ctx.req)));
+				return true;
+			}
+
+		// Rejected before query arguments are parsed and before the handler coroutine exists.
+		using limit = find_policy<rate_limit_policy, typename re::policies>::type;
+		if constexpr (!std::is_void_v<limit>)
+			if (!route_rate_limiter<route, limit>::try_acquire(ctx.req, ctx.peer ? &ctx.peer->address : nullptr))
+			{
+				result.emplace(ready(rate_limited_response(ctx.req)));
+				return true;
+			}
+
+		if (!fill_non_path_args(values, ctx))
 		{
-			fill_non_path_args(values, ctx);
-			if constexpr (re::is_awaitable)
-				co_return (co_await std::apply(route, std::move(values))).value;
-			else
-				return std::apply(route, std::move(values)).value;
+			error = route_error::bad_parameter;
+			return true;
+		}
+		tracing::record(ctx.trace, ctx.match_span, re::route_name, ctx.match_begin);
+		result.emplace(invoke<route>(std::move(values), ctx));
+		return true;
+	}
+
+	// Routes [first, last) are tried in order; the first match decides.
+	template<typename explicit_args_tuple>
+	expected_return_type dispatch(explicit_args_tuple expl_args, const route_context& ctx, size_t first, size_t last)
+	{
+		std::optional<return_type> result;
+		route_error error{ route_error::no_route };
+		for (size_t i{ first }; i < last; ++i)
+			if ((this->*route_table<explicit_args_tuple>[i])(expl_args, ctx, result, error))
+				break;
+
+		if constexpr (is_async)
+		{
+			if (!result)
+				co_return std::unexpected{ error };
+			co_return co_await std::move(*result);
 		}
 		else
 		{
-			if constexpr (re::is_awaitable)
-				co_return co_await try_route<explicit_args_tuple, other_routes...>(std::move(expl_args), ctx);
-			else
-				return try_route<explicit_args_tuple, other_routes...>(std::move(expl_args), ctx);
+			if (!result)
+				return std::unexpected{ error };
+			return std::move(*result);
+		}
+	}
+
+	template<auto route>
+	bool try_resolve(const route_context& ctx, route_resolution& resolution)
+	{
+		using re = route_extractor<decltype(route)>;
+		typename re::args values{};
+		if (!matches<re>(ctx, values))
+			return false;
+
+		resolution.allowed = resolution.allowed | re::mask;
+		if (!(re::mask & ctx.req.method()))
+		{
+			resolution.status = route_resolution::status_t::method_not_allowed;
+			return false;
 		}
+
+		tracing::record(ctx.trace, "match", re::route_name, ctx.match_begin);
+		resolution.status = route_resolution::status_t::ok;
+		resolution.websocket = !std::is_void_v<typename find_policy<websocket_policy, typename re::policies>::type>;
+		using limit = find_policy<body_limit_policy, typename re::policies>::type;
+		if constexpr (!std::is_void_v<limit>)
+			resolution.body_limit = limit::bytes;
+		return true;
 	}
 
+	template<auto route>
+	static std::array<std::optional<std::string>, 2> match_outcome(const route_context& ctx)
+	{
+		using re = route_extractor<decltype(route)>;
+		std::array<std::optional<std::string>, 2> outcome;
+		if (typename re::args values{}; matches<re>(ctx, values))
+			outcome[0] = coalescing_key(values);
+		if (typename re::args values{}; matches_characters<re>(ctx, values))
+			outcome[1] = coalescing_key(values);
+		return outcome;
+	}
+
+	// One entry per route, in order. Routes are tried through the table rather than a fold over
+	// the pack, which nests one level of parentheses per route and exceeds the compilers'
+	// bracket depth on tables with hundreds of routes.
+	template<typename explicit_args_tuple>
+	using try_route_t = bool (router_t::*)(const explicit_args_tuple&, const route_context&, std::optional<return_type>&, route_error&);
+
+	template<typename explicit_args_tuple>
+	static constexpr std::array<try_route_t<explicit_args_tuple>, sizeof...(routes)> route_table{ &router_t::try_route<routes, explicit_args_tuple>... };
+
+	using try_resolve_t = bool (router_t::*)(const route_context&, route_resolution&);
+	static constexpr std::array<try_resolve_t, sizeof...(routes)> resolve_table{ &router_t::try_resolve<routes>... };
+
 	template<typename...explicit_args>
-	return_type route_explicit(std::string url, request req, explicit_args...expl_args)
+	expected_return_type route_explicit(std::string_view url, request& req, explicit_args...expl_args)
 	{
+		auto trace{ find_explicit_arg<tracing::request_trace*>(expl_args...) };
+		auto parse_begin{ trace && trace->sampled ? tracing::timestamp() : 0 };
 		auto parsed_url{ boost::urls::parse_origin_form(url) };
 		if (parsed_url.has_error())
-			throw std::runtime_error{ "url parse error" };
-		route_context ctx{ *parsed_url, std::move(req) };
+		{
+			if constexpr (is_async)
+				co_return std::unexpected{ route_error::bad_url };
+			else
+				return std::unexpected{ route_error::bad_url };
+		}
+		route_context ctx{ *parsed_url, req };
+		tracing::record(trace, "parse_url", {}, parse_begin);
+		if constexpr (is_async)
+			co_return co_await route_in_context(ctx, 0, sizeof...(routes), std::forward<explicit_args>(expl_args)...);
+		else
+			return route_in_context(ctx, 0, sizeof...(routes), std::forward<explicit_args>(expl_args)...);
+	}
+
+	// Tries routes [first, last) for a request whose URL is already parsed.
+	template<typename...explicit_args>
+	expected_return_type route_in_context(route_context& ctx, size_t first, size_t last, explicit_args...expl_args)
+	{
+		auto trace{ find_explicit_arg<tracing::request_trace*>(expl_args...) };
+		ctx.trace = trace;
+		ctx.peer = find_explicit_arg<peer_info*>(expl_args...);
+		ctx.loop = find_explicit_arg<boost::asio::io_context*>(expl_args...);
+		ctx.match = find_explicit_arg<access_logging::matched_route*>(expl_args...);
+		ctx.upgrade = find_explicit_arg<websocket_upgrade*>(expl_args...);
+		if (trace && trace->sampled)
+			ctx.match_begin = tracing::timestamp();
 
 		using specific_reroute_t = basic_reroute_t<return_type>;
 		if constexpr ((std::is_same_v<specific_reroute_t, explicit_args> || ...))
@@ -603,67 +1147,157 @@ private:
 			using explicit_arg_tuple = std::tuple<request*, explicit_args...>;
 
 			if constexpr (is_async)
-				co_return co_await try_route<explicit_arg_tuple, routes...>(std::make_tuple(&ctx.req, expl_args...), ctx);
+				co_return co_await dispatch<explicit_arg_tuple>(std::make_tuple(&ctx.req, expl_args...), ctx, first, last);
 			else
-				return try_route<explicit_arg_tuple, routes...>(std::make_tuple(&ctx.req, expl_args...), ctx);
+				return dispatch<explicit_arg_tuple>(std::make_tuple(&ctx.req, expl_args...), ctx, first, last);
 		}
 		else
 		{
 			specific_reroute_t reroute{
 				[&](std::string reroute_url) mutable -> return_type
 				{
+					tracing::span hop{ ctx.trace, "reroute" };
+					auto version{ ctx.req.version() };
+					auto keep_alive{ ctx.req.keep_alive() };
 					if constexpr (is_async)
-						co_return co_await route_explicit(std::move(reroute_url), std::move(ctx.req), std::forward<explicit_args>(expl_args)...);
+						co_return to_response(co_await route_explicit(reroute_url, ctx.req, std::forward<explicit_args>(expl_args)...), version, keep_alive);
 					else
-						return route_explicit(std::move(reroute_url), std::move(ctx.req), std::forward<explicit_args>(expl_args)...);
+						return to_response(route_explicit(reroute_url, ctx.req, std::forward<explicit_args>(expl_args)...), version, keep_alive);
 				}
 			};
 
 			using explicit_arg_tuple = std::tuple<request*, specific_reroute_t, explicit_args...>;
 
 			if constexpr (is_async)
-				co_return co_await try_route<explicit_arg_tuple, routes...>(std::make_tuple(&ctx.req, std::move(reroute), std::forward<explicit_args>(expl_args)...), ctx);
+				co_return co_await dispatch<explicit_arg_tuple>(std::make_tuple(&ctx.req, std::move(reroute), std::forward<explicit_args>(expl_args)...), ctx, first, last);
 			else
-				return try_route<explicit_arg_tuple, routes...>(std::make_tuple(&ctx.req, std::move(reroute), std::forward<explicit_args>(expl_args)...), ctx);
+				return dispatch<explicit_arg_tuple>(std::make_tuple(&ctx.req, std::move(reroute), std::forward<explicit_args>(expl_args)...), ctx, first, last);
 		}
 	}
 public:
+	// A request head resolved to its endpoint, with its URL parsed and its path segmented. It
+	// refers to the head, which must stay in place (its body may still be read into it) until
+	// the request is routed.
+	class resolved_request
+	{
+		friend router_t;
+
+		route_resolution m_resolution;
+		request* m_head{};
+		std::optional<route_context> m_ctx;
+		size_t m_route{ sizeof...(routes) };
+
+	public:
+		const route_resolution& resolution() const noexcept
+		{
+			return m_resolution;
+		}
+	};
+
+	// Finds the endpoint route() would pick for a request head without running anything, so a
+	// server can turn the request away before reading its body, and route it afterwards without
+	// parsing its target again or trying the other endpoints; the resolved one is matched once
+	// more to bind its arguments. Parsing and matching are recorded in `trace`.
+	const route_resolution& resolve(request& head, resolved_request& resolved, tracing::request_trace* trace = nullptr)
+	{
+		resolved.m_resolution = {};
+		resolved.m_head = &head;
+		resolved.m_ctx.reset();
+		resolved.m_route = sizeof...(routes);
+
+		auto parse_begin{ trace && trace->sampled ? tracing::timestamp() : 0 };
+		auto parsed_url{ boost::urls::parse_origin_form(head.target()) };
+		if (parsed_url.has_error())
+		{
+			resolved.m_resolution.status = route_resolution::status_t::bad_url;
+			return resolved.m_resolution;
+		}
+
+		auto& ctx{ resolved.m_ctx.emplace(*parsed_url, head) };
+		tracing::record(trace, "parse_url", {}, parse_begin);
+		ctx.trace = trace;
+		if (trace && trace->sampled)
+			ctx.match_begin = tracing::timestamp();
+		ctx.match_span = "bind";
+		for (size_t i{}; i < resolve_table.size(); ++i)
+			if ((this->*resolve_table[i])(ctx, resolved.m_resolution))
+			{
+				resolved.m_route = i;
+				break;
+			}
+		return resolved.m_resolution;
+	}
+
+	// Matches `target` against every route twice, through matches() (segment by segment where the
+	// route and the path allow it) and through the character matcher alone. An outcome holds the
+	// path arguments bound, as a coalescing key, or nothing when the route did not match; tests
+	// check that the two always agree.
+	static std::array<std::array<std::optional<std::string>, 2>, sizeof...(routes)> match_outcomes(std::string_view target)
+	{
+		auto parsed_url{ boost::urls::parse_origin_form(target) };
+		if (parsed_url.has_error())
+			return {};
+
+		request head{ boost::beast::http::verb::get, target, 11 };
+		route_context ctx{ *parsed_url, head };
+		return { match_outcome<routes>(ctx)... };
+	}
+
+	// Routes the request and reports malformed URLs, unparsable arguments and unmatched requests
+	// as a route_error instead of a response. The request is used in place (handlers see it
+	// through request*) and must outlive the returned awaitable.
 	template<typename...explicit_args>
-	return_type route(request req, explicit_args...expl_args)
+	expected_return_type route_expected(request& req, explicit_args...expl_args)
 	{
-		std::string target{ req.target() };
+		tracing::route_scope scope{ find_explicit_arg<tracing::request_trace*>(expl_args...) };
 		if constexpr (is_async)
-			co_return co_await route_explicit<explicit_args...>(std::move(target), std::move(req), std::forward<explicit_args>(expl_args)...);
+			co_return co_await route_explicit<explicit_args...>(req.target(), req, std::forward<explicit_args>(expl_args)...);
 		else
-			return route_explicit<explicit_args...>(std::move(target), std::move(req), std::forward<explicit_args>(expl_args)...);
+			return route_explicit<explicit_args...>(req.target(), req, std::forward<explicit_args>(expl_args)...);
 	}
-};
 
-namespace v2
-{
-	namespace detail
+	// Like route_expected, with routing errors turned into canned 400/404 responses for the
+	// request's version and keep-alive setting.
+	template<typename...explicit_args>
+	return_type route(request& req, explicit_args...expl_args)
 	{
-		template<typename T>
-		struct filter_out_argument_patterns;
-
-		template<>
-		struct filter_out_argument_patterns<std::tuple<>>
-		{
-			using type = std::tuple<>;
-		};
+		auto version{ req.version() };
+		auto keep_alive{ req.keep_alive() };
+		if constexpr (is_async)
+			co_return to_response(co_await route_expected<explicit_args...>(req, std::forward<explicit_args>(expl_args)...), version, keep_alive);
+		else
+			return to_response(route_expected<explicit_args...>(req, std::forward<explicit_args>(expl_args)...), version, keep_alive);
+	}
 
-		template<typename first_pattern, typename...other_patterns>
-		struct filter_out_argument_patterns<std::tuple<first_pattern, other_patterns...>>
+	// Like route, for a request resolve() has already matched: only the resolved endpoint is
+	// tried. Requests that did not resolve to one get the 400/404 route would give them.
+	template<typename...explicit_args>
+	return_type route(resolved_request& resolved, explicit_args...expl_args)
+	{
+		tracing::route_scope scope{ find_explicit_arg<tracing::request_trace*>(expl_args...) };
+		auto version{ resolved.m_head->version() };
+		auto keep_alive{ resolved.m_head->keep_alive() };
+		auto first{ resolved.m_route };
+		auto last{ std::min(first + 1, sizeof...(routes)) };
+		if constexpr (is_async)
 		{
-			using type = typename filter_out_argument_patterns<std::tuple<other_patterns...>>::type;
-		};
-
-		template<literal L, typename...other_patterns>
-		struct filter_out_argument_patterns<std::tuple<argument_pattern<L>, other_patterns...>>
+			if (!resolved.m_ctx)
+				co_return error_response(route_error::bad_url, version, keep_alive);
+			co_return to_response(co_await route_in_context(*resolved.m_ctx, first, last, std::forward<explicit_args>(expl_args)...), version, keep_alive);
+		}
+		else
 		{
-			using type = decltype(std::tuple_cat(std::declval<std::tuple<argument_pattern<L>>>(), std::declval<typename filter_out_argument_patterns<std::tuple<other_patterns...>>::type>()));
-		};
+			if (!resolved.m_ctx)
+				return error_response(route_error::bad_url, version, keep_alive);
+			return to_response(route_in_context(*resolved.m_ctx, first, last, std::forward<explicit_args>(expl_args)...), version, keep_alive);
+		}
+	}
+};
 
+namespace v2
+{
+	namespace detail
+	{
 		template<typename T>
 		struct pattern_classifier;
 
@@ -702,51 +1336,52 @@ namespace v2
 			static constexpr bool is_argument{ true };
 		};
 
-		template<typename tuple>
-		struct tuple_decapitator;
+		template<typename T>
+		struct filter_out_argument_patterns;
 
-		template<typename first, typename...rest>
-		struct tuple_decapitator<std::tuple<first, rest...>>
+		template<typename...patterns>
+		struct filter_out_argument_patterns<std::tuple<patterns...>>
 		{
-			using type = std::tuple<rest...>;
+			using type = decltype(std::tuple_cat(std::declval<std::conditional_t<pattern_classifier<patterns>::is_argument, std::tuple<patterns>, std::tuple<>>>()...));
 		};
 
-		template<typename pattern_tuple, typename function_argument_tuple>
-		consteval auto compose_regex()
+		template<typename pattern, typename function_argument_tuple>
+		consteval auto pattern_regex()
 		{
-			if constexpr (std::is_same_v<pattern_tuple, std::tuple<>>)
-				return literal{ "" };
-			else
+			using classifier = pattern_classifier<pattern>;
+
+			if constexpr (classifier::is_fixed)
 			{
-				using first_pattern = typename std::decay_t<decltype(std::get<0>(std::declval<pattern_tuple>()))>;
-				using classifier = pattern_classifier<first_pattern>;
+				if constexpr (classifier::is_wildcard)
+				{
+					if constexpr (classifier::is_asterisk)
+						return literal{ R"([^/]*)" };
+					else if constexpr (classifier::is_double_asterisk)
+						return literal{ R"(.*)" };
+				}
+				else
+					return pattern::lit;
+			}
+			else if constexpr (classifier::is_argument)
+			{
+				using arg_type = typename arg_finder<0, pattern, function_argument_tuple>::type;
+				if constexpr (std::is_same_v<arg_type, std::string> || std::is_same_v<arg_type, std::string_view>)
+					return literal{ R"(([^/]*))" };
+				else if constexpr (std::is_integral_v<arg_type>)
+					return literal{ R"((\d+))" };
+			}
+		}
 
-				auto first_regex{ []() constexpr {
-					if constexpr (classifier::is_fixed)
-					{
-						if constexpr (classifier::is_wildcard)
-						{
-							if constexpr (classifier::is_asterisk)
-								return literal{ R"([^/]*)" };
-							else if constexpr (classifier::is_double_asterisk)
-								return literal{ R"(.*)" };
-						}
-						else
-							return first_pattern::lit;
-					}
-					else if constexpr (classifier::is_argument)
-					{
-						using arg_type = typename arg_finder<0, first_pattern, function_argument_tuple>::type;
-						if constexpr (std::is_same_v<arg_type, std::string> || std::is_same_v<arg_type, std::string_view>)
-							return literal{ R"(([^/]*))" };
-						else if constexpr (std::is_integral_v<arg_type>)
-							return literal{ R"((\d+))" };
-					}
-				}() };
+		template<typename function_argument_tuple, typename...patterns>
+		consteval auto compose_regex_impl(std::tuple<patterns...>*)
+		{
+			return (literal{ "" } + ... + pattern_regex<patterns, function_argument_tuple>());
+		}
 
-				using other_patterns = tuple_decapitator<pattern_tuple>::type;
-				return first_regex + compose_regex<other_patterns, function_argument_tuple>();
-			}
+		template<typename pattern_tuple, typename function_argument_tuple>
+		consteval auto compose_regex()
+		{
+			return compose_regex_impl<function_argument_tuple>(static_cast<pattern_tuple*>(nullptr));
 		}
 
 		template<typename T>
@@ -795,8 +1430,7 @@ namespace v2
 	struct basic_endpoint
 	{
 		static constexpr verb_mask mask{ verb_mask_ };
-		using pattern_chain = decltype(parse_route_string<route_string>());
-		using pattern_tuple = typename dechain<pattern_chain>::tuple;
+		using pattern_tuple = decltype(parse_route_string<route_string>());
 		using argument_pattern_tuple = typename detail::filter_out_argument_patterns<pattern_tuple>::type;
 
 		using return_type_t = result_t;
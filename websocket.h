@@ -0,0 +1,236 @@
+#pragma once
+#include "includes.h"
+#include "timer_wheel.h"
+#include "canned_response.h"
+
+struct websocket_policy {};
+
+// Endpoint policy added by websocket_endpoint: the endpoint only takes WebSocket upgrade requests
+// and its handler runs for the whole WebSocket session.
+struct upgrades_to_websocket : websocket_policy {};
+
+// Message channel of an upgraded connection, handed to websocket_endpoint handlers as ws_channel*.
+// It belongs to the connection's event loop and must only be used from the handler.
+class ws_channel
+{
+public:
+	virtual ~ws_channel() = default;
+
+	// Next message from the peer; std::nullopt once the peer closed the session, the message was
+	// over the server's size limit or the connection failed.
+	virtual boost::asio::awaitable<std::optional<std::string>> receive() = 0;
+
+	// Queues a text message for the connection's writer and returns at once. Returns false, and
+	// drops the message, when the queue is already at the server's limit or the session is closing.
+	virtual bool send(std::string message) = 0;
+
+	// With latest_wins set, a message sent while earlier ones still wait in the queue replaces
+	// them: a slow client gets the newest state instead of a growing backlog.
+	virtual void latest_wins(bool enabled) = 0;
+
+	// Messages send has dropped so far.
+	virtual uint64_t dropped() const = 0;
+};
+
+// Explicit router argument on WebSocket upgrade requests, through which a websocket_endpoint
+// takes over the connection.
+class websocket_upgrade
+{
+public:
+	using handler_t = std::move_only_function<boost::asio::awaitable<void>(ws_channel&)>;
+
+	virtual ~websocket_upgrade() = default;
+
+	// Completes the handshake for `req`, runs `handler` with the session's channel and closes the
+	// session once the handler has returned and the queued messages are written.
+	virtual boost::asio::awaitable<void> run(const request& req, handler_t handler) = 0;
+};
+
+// What a websocket_endpoint handler returns, and what the router hands back once a session is
+// over: the connection is no longer HTTP and no response may be written to it.
+inline response websocket_closed()
+{
+	return response{ boost::beast::http::status::switching_protocols, 11 };
+}
+
+inline response upgrade_required_response(const request& req)
+{
+	static const canned_response upgrade_required{ boost::beast::http::status::upgrade_required, "websocket upgrade required\n",
+		{ { boost::beast::http::field::upgrade, "websocket" } } };
+	return upgrade_required(req);
+}
+
+// A connection's socket as the WebSocket stream reads it: bytes the HTTP parser had already
+// buffered past the upgrade request come first, as a client may send its first frames right
+// behind the handshake.
+template<typename socket_type>
+class prefixed_socket
+{
+	socket_type& m_socket;
+	boost::beast::flat_buffer& m_prefix;
+
+public:
+	using executor_type = typename socket_type::executor_type;
+
+	prefixed_socket(socket_type& socket, boost::beast::flat_buffer& prefix) : m_socket{ socket }, m_prefix{ prefix } {}
+
+	executor_type get_executor() noexcept
+	{
+		return m_socket.get_executor();
+	}
+
+	template<typename buffers_type, typename token_type>
+	auto async_read_some(const buffers_type& buffers, token_type&& token)
+	{
+		return boost::asio::async_initiate<token_type, void(boost::system::error_code, size_t)>([this](auto handler, const buffers_type& buffers) {
+			if (!m_prefix.size())
+				return m_socket.async_read_some(buffers, std::move(handler));
+			auto bytes{ boost::asio::buffer_copy(buffers, m_prefix.data()) };
+			m_prefix.consume(bytes);
+			boost::asio::post(m_socket.get_executor(), boost::beast::bind_front_handler(std::move(handler), boost::system::error_code{}, bytes));
+		}, token, buffers);
+	}
+
+	template<typename buffers_type, typename token_type>
+	auto async_write_some(const buffers_type& buffers, token_type&& token)
+	{
+		return m_socket.async_write_some(buffers, std::forward<token_type>(token));
+	}
+
+	// Found by the WebSocket stream to shut the socket down when the session closes or fails.
+	friend void teardown(boost::beast::role_type role, prefixed_socket& socket, boost::system::error_code& ec)
+	{
+		using boost::beast::websocket::teardown;
+		teardown(role, socket.m_socket, ec);
+	}
+
+	template<typename handler_type>
+	friend void async_teardown(boost::beast::role_type role, prefixed_socket& socket, handler_type&& handler)
+	{
+		using boost::beast::websocket::async_teardown;
+		async_teardown(role, socket.m_socket, std::forward<handler_type>(handler));
+	}
+
+	friend void beast_close_socket(prefixed_socket& socket)
+	{
+		boost::system::error_code ec;
+		socket.m_socket.close(ec);
+	}
+};
+
+// Server side of a session on a connection's socket, which stays owned by the connection, as
+// does `leftover`, its read buffer. Reads are bounded by `max_message` and queued writes by
+// `max_queued_bytes`; a single writer coroutine drains whatever has been queued back to back and
+// only sleeps once the queue is empty.
+template<typename socket_type>
+class websocket_connection final : public websocket_upgrade, public ws_channel
+{
+	boost::beast::websocket::stream<prefixed_socket<socket_type>> m_ws;
+	timer_wheel::deadline& m_timeout;
+	boost::asio::steady_timer m_wakeup;
+	boost::beast::flat_buffer m_read_buffer;
+	std::deque<std::string> m_queue;
+	size_t m_queued_bytes{};
+	size_t m_max_queued_bytes;
+	uint64_t m_dropped{};
+	bool m_latest_wins{};
+	bool m_closing{};
+	bool m_writer_idle{};
+
+	void wake()
+	{
+		if (m_writer_idle)
+			m_wakeup.cancel();
+	}
+
+	// A failed write ends the session: the exception cancels the handler through the && in run.
+	boost::asio::awaitable<void> writer()
+	{
+		for (;;)
+		{
+			while (!m_queue.empty())
+			{
+				auto message{ std::move(m_queue.front()) };
+				m_queue.pop_front();
+				m_queued_bytes -= message.size();
+				co_await m_ws.async_write(boost::asio::buffer(message), use_awaitable);
+			}
+			if (m_closing)
+				co_return;
+
+			m_writer_idle = true;
+			co_await m_wakeup.async_wait(boost::asio::as_tuple(use_awaitable));
+			m_writer_idle = false;
+		}
+	}
+
+	boost::asio::awaitable<void> run_handler(handler_t handler)
+	{
+		co_await handler(*this);
+		m_closing = true;
+		wake();
+	}
+
+public:
+	websocket_connection(socket_type& socket, boost::beast::flat_buffer& leftover, timer_wheel::deadline& timeout, size_t max_message, size_t max_queued_bytes)
+		: m_ws{ socket, leftover }, m_timeout{ timeout }, m_wakeup{ socket.get_executor(), boost::asio::steady_timer::time_point::max() },
+		m_max_queued_bytes{ max_queued_bytes }
+	{
+		m_ws.read_message_max(max_message);
+		m_ws.text(true);
+	}
+
+	boost::asio::awaitable<void> run(const request& req, handler_t handler) override
+	{
+		// The session replaces the request deadline with Beast's idle timeout, which pings a
+		// quiet peer while the handler waits in receive.
+		m_timeout.cancel();
+		m_ws.set_option(boost::beast::websocket::stream_base::timeout::suggested(boost::beast::role_type::server));
+		co_await m_ws.async_accept(req, use_awaitable);
+
+		using namespace boost::asio::experimental::awaitable_operators;
+		co_await (run_handler(std::move(handler)) && writer());
+
+		// Fails harmlessly when the peer already closed the session.
+		co_await m_ws.async_close(boost::beast::websocket::close_code::normal, boost::asio::as_tuple(use_awaitable));
+	}
+
+	boost::asio::awaitable<std::optional<std::string>> receive() override
+	{
+		m_read_buffer.clear();
+		auto [ec, bytes] { co_await m_ws.async_read(m_read_buffer, boost::asio::as_tuple(use_awaitable)) };
+		if (ec)
+			co_return std::nullopt;
+		co_return boost::beast::buffers_to_string(m_read_buffer.data());
+	}
+
+	bool send(std::string message) override
+	{
+		if (m_closing)
+			return false;
+		if (m_latest_wins)
+		{
+			m_queue.clear();
+			m_queued_bytes = 0;
+		}
+		if (m_queued_bytes + message.size() > m_max_queued_bytes)
+		{
+			++m_dropped;
+			return false;
+		}
+		m_queued_bytes += message.size();
+		m_queue.push_back(std::move(message));
+		wake();
+		return true;
+	}
+
+	void latest_wins(bool enabled) override
+	{
+		m_latest_wins = enabled;
+	}
+
+	uint64_t dropped() const override
+	{
+		return m_dropped;
+	}
+};
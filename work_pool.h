@@ -0,0 +1,186 @@
+#pragma once
+#include "includes.h"
+
+struct cpu_bound_policy {};
+
+// Endpoint policy: the handler body runs on work_pool::instance() and the router resumes on the
+// connection's executor to write the response. Such handlers must not touch event loop objects
+// (asio::io_context*, timer_wheel*) handed to them by the server.
+struct cpu_bound : cpu_bound_policy {};
+
+// Work-stealing thread pool usable as an asio executor. Every worker owns a deque: it pushes and
+// pops its own work at the back and steals from the front of the others when it runs dry.
+class work_pool : public boost::asio::execution_context
+{
+	using task = std::move_only_function<void()>;
+
+	struct worker
+	{
+		std::mutex mutex;
+		std::deque<task> tasks;
+		std::atomic<size_t> depth{};
+		std::atomic<size_t> max_depth{};
+		std::atomic<uint64_t> executed{};
+		std::atomic<uint64_t> stolen{};
+	};
+
+	std::vector<std::unique_ptr<worker>> m_workers;
+	std::atomic<size_t> m_next{};
+	std::atomic<size_t> m_pending{};
+	std::mutex m_idle_mutex;
+	std::condition_variable_any m_idle;
+	std::vector<std::jthread> m_threads;
+
+	static inline thread_local const work_pool* t_pool{};
+	static inline thread_local size_t t_index{};
+
+	void push(size_t index, task t)
+	{
+		auto& w{ *m_workers[index] };
+		m_pending.fetch_add(1, std::memory_order_release);
+		{
+			std::scoped_lock lock{ w.mutex };
+			w.tasks.push_back(std::move(t));
+		}
+		auto depth{ w.depth.fetch_add(1, std::memory_order_relaxed) + 1 };
+		auto max{ w.max_depth.load(std::memory_order_relaxed) };
+		while (depth > max && !w.max_depth.compare_exchange_weak(max, depth, std::memory_order_relaxed));
+
+		std::scoped_lock lock{ m_idle_mutex };
+		m_idle.notify_one();
+	}
+
+	std::optional<task> pop(size_t index)
+	{
+		for (size_t i{}; i < m_workers.size(); ++i)
+		{
+			auto& w{ *m_workers[(index + i) % m_workers.size()] };
+			std::scoped_lock lock{ w.mutex };
+			if (w.tasks.empty())
+				continue;
+
+			task t;
+			if (!i)
+			{
+				t = std::move(w.tasks.back());
+				w.tasks.pop_back();
+			}
+			else
+			{
+				t = std::move(w.tasks.front());
+				w.tasks.pop_front();
+				m_workers[index]->stolen.fetch_add(1, std::memory_order_relaxed);
+			}
+			w.depth.fetch_sub(1, std::memory_order_relaxed);
+			m_pending.fetch_sub(1, std::memory_order_relaxed);
+			return t;
+		}
+		return std::nullopt;
+	}
+
+	void run(std::stop_token stop, size_t index)
+	{
+		t_pool = this;
+		t_index = index;
+		while (!stop.stop_requested())
+		{
+			if (auto t{ pop(index) })
+			{
+				(*t)();
+				m_workers[index]->executed.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+			std::unique_lock lock{ m_idle_mutex };
+			m_idle.wait(lock, stop, [&] { return m_pending.load(std::memory_order_acquire) > 0; });
+		}
+	}
+
+public:
+	class executor_type
+	{
+		work_pool* m_pool;
+
+	public:
+		explicit executor_type(work_pool& pool) noexcept : m_pool{ &pool } {}
+
+		work_pool& query(boost::asio::execution::context_t) const noexcept
+		{
+			return *m_pool;
+		}
+
+		static constexpr boost::asio::execution::blocking_t query(boost::asio::execution::blocking_t) noexcept
+		{
+			return boost::asio::execution::blocking.never;
+		}
+
+		executor_type require(boost::asio::execution::blocking_t::never_t) const noexcept
+		{
+			return *this;
+		}
+
+		template<typename F>
+		void execute(F f) const
+		{
+			m_pool->submit(std::move(f));
+		}
+
+		bool operator ==(const executor_type&) const noexcept = default;
+	};
+
+	struct worker_stats
+	{
+		size_t queue_depth;
+		size_t max_queue_depth;
+		uint64_t executed;
+		uint64_t stolen;
+	};
+
+	explicit work_pool(size_t thread_count = std::max(std::thread::hardware_concurrency(), 1u))
+	{
+		for (size_t i{}; i < thread_count; ++i)
+			m_workers.push_back(std::make_unique<worker>());
+		for (size_t i{}; i < thread_count; ++i)
+			m_threads.emplace_back([this, i](std::stop_token stop) { run(stop, i); });
+	}
+
+	~work_pool()
+	{
+		for (auto& t : m_threads)
+			t.request_stop();
+		m_threads.clear();
+		shutdown();
+		destroy();
+	}
+
+	// Pool shared by all cpu_bound endpoints, one worker per hardware thread.
+	static work_pool& instance()
+	{
+		static work_pool pool;
+		return pool;
+	}
+
+	executor_type get_executor() noexcept
+	{
+		return executor_type{ *this };
+	}
+
+	// Work submitted from one of the pool's own workers stays on that worker's deque.
+	void submit(task t)
+	{
+		push(t_pool == this ? t_index : m_next.fetch_add(1, std::memory_order_relaxed) % m_workers.size(), std::move(t));
+	}
+
+	size_t queue_depth() const noexcept
+	{
+		return m_pending.load(std::memory_order_relaxed);
+	}
+
+	std::vector<worker_stats> stats() const
+	{
+		std::vector<worker_stats> result;
+		for (auto& w : m_workers)
+			result.push_back({ w->depth.load(std::memory_order_relaxed), w->max_depth.load(std::memory_order_relaxed),
+				w->executed.load(std::memory_order_relaxed), w->stolen.load(std::memory_order_relaxed) });
+		return result;
+	}
+};